@@ -5,6 +5,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <algorithm>
+
+#include "box_batch.h"
 #include "utils.h"
 
 #ifndef M_PI
@@ -369,55 +372,332 @@ Box::AbsBox::AbsBox(Box const& b1, Box const& b2)
   bottom = fmax(ab1.bottom, ab2.bottom);
 }
 
-int NmsComparator(const void* pa, const void* pb)
+namespace
+{
+typedef struct NmsCand
 {
-  Detection* a = (Detection*)pa;
-  Detection* b = (Detection*)pb;
+  int idx;   // index of the detection
+  int slot;  // index of the class probability within the detection
+  float prob;
+} NmsCand;
 
-  float diff = 0;
-  if (b->sort_class >= 0)
-    diff = a->prob[b->sort_class] - b->prob[b->sort_class];
-  else
-    diff = a->objectness - b->objectness;
+bool NmsCandComparator(NmsCand const& a, NmsCand const& b)
+{
+  if (a.prob != b.prob)
+    return a.prob > b.prob;
+  return a.idx < b.idx;
+}
+
+// Loads the boxes of candidates sorted by descending probability
+template <typename Det>
+void AssignCands(
+    BoxBatch& boxes, Det const* dets, std::vector<NmsCand> const& cands)
+{
+  boxes.Clear();
+  boxes.Reserve((int)cands.size());
+  for (size_t i = 0; i < cands.size(); ++i)
+  {
+    boxes.Push(dets[cands[i].idx].bbox);
+  }
+}
+
+// Uniform grid over box centers with cells as large as the largest box, so a
+// box can only overlap boxes binned into its own or the 8 neighbouring cells
+class NmsGrid
+{
+ public:
+  void Build(BoxBatch const& boxes)
+  {
+    int n = boxes.Size();
+
+    float x_min = FLT_MAX, x_max = -FLT_MAX;
+    float y_min = FLT_MAX, y_max = -FLT_MAX;
+    float max_w = 0.0f, max_h = 0.0f;
+    for (int i = 0; i < n; ++i)
+    {
+      float cx = (boxes.left[i] + boxes.right[i]) / 2;
+      float cy = (boxes.top[i] + boxes.bottom[i]) / 2;
+      x_min = min_val_cmp(x_min, cx);
+      x_max = max_val_cmp(x_max, cx);
+      y_min = min_val_cmp(y_min, cy);
+      y_max = max_val_cmp(y_max, cy);
+      max_w = max_val_cmp(max_w, boxes.right[i] - boxes.left[i]);
+      max_h = max_val_cmp(max_h, boxes.bottom[i] - boxes.top[i]);
+    }
+
+    // inflate cells slightly to stay on the safe side of rounding
+    x_min_ = x_min;
+    y_min_ = y_min;
+    cell_w_ = max_val_cmp(max_w * 1.001f, FLT_EPSILON);
+    cell_h_ = max_val_cmp(max_h * 1.001f, FLT_EPSILON);
+    cell_w_ = max_val_cmp(cell_w_, (x_max - x_min) / kMaxCells);
+    cell_h_ = max_val_cmp(cell_h_, (y_max - y_min) / kMaxCells);
+    cols_ = (int)((x_max - x_min) / cell_w_) + 1;
+    rows_ = (int)((y_max - y_min) / cell_h_) + 1;
+
+    // cell lists in CSR layout, indexes ascending within each cell
+    cell_of_.resize(n);
+    start_.assign(rows_ * cols_ + 1, 0);
+    for (int i = 0; i < n; ++i)
+    {
+      float cx = (boxes.left[i] + boxes.right[i]) / 2;
+      float cy = (boxes.top[i] + boxes.bottom[i]) / 2;
+      int col = min_val_cmp((int)((cx - x_min_) / cell_w_), cols_ - 1);
+      int row = min_val_cmp((int)((cy - y_min_) / cell_h_), rows_ - 1);
+      cell_of_[i] = row * cols_ + col;
+      start_[cell_of_[i] + 1]++;
+    }
+    for (int c = 0; c < rows_ * cols_; ++c)
+    {
+      start_[c + 1] += start_[c];
+    }
+    items_.resize(n);
+    std::vector<int> fill(start_.begin(), start_.end() - 1);
+    for (int i = 0; i < n; ++i)
+    {
+      items_[fill[cell_of_[i]]++] = i;
+    }
+  }
 
-  if (diff < 0)
-    return 1;
-  else if (diff > 0)
-    return -1;
+  // Flags every box after box i in sorted order, binned next to it, whose IoU
+  // with box i exceeds thresh; valid for thresh >= 0 only
+  void FlagIou(BoxBatch const& boxes, int i, float thresh, char* flags) const
+  {
+    int row = cell_of_[i] / cols_;
+    int col = cell_of_[i] % cols_;
+    for (int r = max_val_cmp(row - 1, 0); r <= min_val_cmp(row + 1, rows_ - 1);
+         ++r)
+    {
+      for (int c = max_val_cmp(col - 1, 0);
+           c <= min_val_cmp(col + 1, cols_ - 1); ++c)
+      {
+        int const* begin = &items_[0] + start_[r * cols_ + c];
+        int const* end = &items_[0] + start_[r * cols_ + c + 1];
+        for (int const* it = std::upper_bound(begin, end, i); it != end; ++it)
+        {
+          if (!flags[*it] && boxes.Iou(i, *it) > thresh)
+            flags[*it] = 1;
+        }
+      }
+    }
+  }
+
+ private:
+  static int const kMaxCells = 256;
+
+  float x_min_, y_min_;
+  float cell_w_, cell_h_;
+  int rows_, cols_;
+
+  std::vector<int> cell_of_;
+  std::vector<int> start_;
+  std::vector<int> items_;
+};
+
+// Parallel Fast-NMS (https://arxiv.org/abs/1904.02689) and Matrix-NMS
+// (https://arxiv.org/abs/2003.10152) on the upper-triangular IoU matrix of
+// boxes sorted by descending probability. Only the first num_sup boxes may
+// suppress others, matching the greedy scan which skips near-zero boxes.
+//
+// FAST_NMS suppresses box j when the column-wise max IoU over i < j exceeds
+// thresh, even if box i is suppressed itself. MATRIX_NMS decays box j with
+// the linear kernel min_i (1 - iou_ij) / (1 - max_iou_i) and suppresses it
+// once the decay falls below 1 - thresh, i.e. thresh keeps its IoU meaning.
+void MatrixNms(BoxBatch const& boxes, int num_sup, float thresh,
+    NMS_KIND nms_kind, std::vector<float>& decay)
+{
+  int n = boxes.Size();
+  std::vector<float> max_iou(n, 0.0f);
+  decay.assign(n, 1.0f);
+
+#pragma omp parallel
+  {
+    std::vector<float> row(n);
+
+#pragma omp for schedule(dynamic, 32)
+    for (int j = 1; j < n; ++j)
+    {
+      int m = min_val_cmp(j, num_sup);
+      boxes.Iou(boxes.Get(j), 0, m, row.data());
+      float max_val = 0.0f;
+      for (int i = 0; i < m; ++i)
+      {
+        max_val = max_val_cmp(max_val, row[i]);
+      }
+      max_iou[j] = max_val;
+    }
+
+    if (nms_kind == MATRIX_NMS)
+    {
+#pragma omp for schedule(dynamic, 32)
+      for (int j = 1; j < n; ++j)
+      {
+        int m = min_val_cmp(j, num_sup);
+        boxes.Iou(boxes.Get(j), 0, m, row.data());
+        float min_val = 1.0f;
+        for (int i = 0; i < m; ++i)
+        {
+          float comp = max_val_cmp(1.0f - max_iou[i], FLT_EPSILON);
+          min_val = min_val_cmp(min_val, (1.0f - row[i]) / comp);
+        }
+        decay[j] = min_val;
+      }
+    }
+  }
+
+  if (nms_kind == FAST_NMS)
+  {
+    for (int j = 1; j < n; ++j)
+    {
+      if (max_iou[j] > thresh)
+        decay[j] = 0.0f;
+    }
+  }
   else
-    return 0;
+  {
+    for (int j = 1; j < n; ++j)
+    {
+      if (decay[j] < 1.0f - thresh)
+        decay[j] = 0.0f;
+    }
+  }
+}
+
+// bucket candidates by class in one pass over the detections
+void BucketCands(Detection const* dets, int total, int classes,
+    std::vector<std::vector<NmsCand>>& buckets)
+{
+  for (int i = 0; i < total; ++i)
+  {
+    for (int k = 0; k < classes; ++k)
+    {
+      if (dets[i].prob[k] > 0)
+        buckets[k].push_back(NmsCand{i, k, dets[i].prob[k]});
+    }
+  }
+}
+
+void BucketCands(SparseDetection const* dets, int total, int classes,
+    std::vector<std::vector<NmsCand>>& buckets)
+{
+  for (int i = 0; i < total; ++i)
+  {
+    for (int s = 0; s < dets[i].num_probs; ++s)
+    {
+      ClassProb const& cp = dets[i].probs[s];
+      if (cp.prob > 0 && cp.cid < classes)
+        buckets[cp.cid].push_back(NmsCand{i, s, cp.prob});
+    }
+  }
+}
+
+float& CandProb(Detection* dets, NmsCand const& cand)
+{
+  return dets[cand.idx].prob[cand.slot];
+}
+
+float& CandProb(SparseDetection* dets, NmsCand const& cand)
+{
+  return dets[cand.idx].probs[cand.slot].prob;
 }
 
 // https://github.com/Zzh-tju/DIoU-darknet
 // https://arxiv.org/abs/1911.08287
-void NmsSort(Detection* dets, int total, int classes, float thresh,
+template <typename Det>
+void NmsSortImpl(Det* dets, int total, int classes, float thresh,
     NMS_KIND nms_kind, float beta)
 {
+  std::vector<std::vector<NmsCand>> buckets(classes);
+  BucketCands(dets, total, classes, buckets);
+
+  BoxBatch boxes;
+  NmsGrid grid;
+  std::vector<char> suppressed;
+  std::vector<char> over;
+  std::vector<float> decay;
   for (int k = 0; k < classes; ++k)
   {
-    for (int i = 0; i < total; ++i)
+    std::vector<NmsCand>& cands = buckets[k];
+    int n = (int)cands.size();
+    if (n < 2)
+      continue;
+
+    std::sort(cands.begin(), cands.end(), NmsCandComparator);
+    AssignCands(boxes, dets, cands);
+
+    if (nms_kind == FAST_NMS || nms_kind == MATRIX_NMS)
     {
-      dets[i].sort_class = k;
+      int num_sup = 0;
+      while (num_sup < n && cands[num_sup].prob >= FLT_EPSILON)
+      {
+        num_sup++;
+      }
+
+      MatrixNms(boxes, num_sup, thresh, nms_kind, decay);
+      for (int i = 0; i < n; ++i)
+      {
+        CandProb(dets, cands[i]) *= decay[i];
+      }
+      continue;
     }
-    qsort(dets, total, sizeof(Detection), NmsComparator);
-    for (int i = 0; i < total; ++i)
+
+    suppressed.assign(n, 0);
+
+    // every pair is suppressed when even disjoint boxes exceed the threshold
+    bool use_grid = nms_kind == GRID_NMS && thresh >= 0;
+    if (use_grid)
+      grid.Build(boxes);
+
+    for (int i = 0; i < n; ++i)
     {
-      if (abs(dets[i].prob[k]) < FLT_EPSILON)
+      if (suppressed[i] || cands[i].prob < FLT_EPSILON)
         continue;
 
-      Box a = dets[i].bbox;
-      for (int j = i + 1; j < total; ++j)
+      if (use_grid)
+      {
+        grid.FlagIou(boxes, i, thresh, suppressed.data());
+      }
+      else if (nms_kind == GREEDY_NMS || nms_kind == GRID_NMS)
       {
-        Box b = dets[j].bbox;
-        if (nms_kind == GREEDY_NMS && Box::Iou(a, b) > thresh)
-          dets[j].prob[k] = 0.0f;
-        else if (nms_kind == DIOU_NMS && Box::Diou(a, b, beta) > thresh)
-          dets[j].prob[k] = 0.0f;
+        boxes.FlagIou(boxes.Get(i), i + 1, n, thresh, suppressed.data());
       }
+      else if (nms_kind == DIOU_NMS)
+      {
+        // DIoU never exceeds IoU, so IoU filters the pairs to be checked
+        over.assign(n, 0);
+        boxes.FlagIou(boxes.Get(i), i + 1, n, thresh, over.data());
+
+        Box const& a = dets[cands[i].idx].bbox;
+        for (int j = i + 1; j < n; ++j)
+        {
+          if (over[j] && Box::Diou(a, dets[cands[j].idx].bbox, beta) > thresh)
+            suppressed[j] = 1;
+        }
+      }
+    }
+
+    for (int i = 0; i < n; ++i)
+    {
+      if (suppressed[i])
+        CandProb(dets, cands[i]) = 0.0f;
     }
   }
 }
 
+}  // namespace
+
+void NmsSort(Detection* dets, int total, int classes, float thresh,
+    NMS_KIND nms_kind, float beta)
+{
+  NmsSortImpl(dets, total, classes, thresh, nms_kind, beta);
+}
+
+void NmsSort(SparseDetection* dets, int total, int classes, float thresh,
+    NMS_KIND nms_kind, float beta)
+{
+  NmsSortImpl(dets, total, classes, thresh, nms_kind, beta);
+}
+
 LIB_API std::vector<MostProbDet> GetMostProbDets(Detection* dets, int num_dets)
 {
   std::vector<MostProbDet> most_prob_dets;
@@ -445,4 +725,56 @@ LIB_API std::vector<MostProbDet> GetMostProbDets(Detection* dets, int num_dets)
   }
 
   return most_prob_dets;
-}
\ No newline at end of file
+}
+LIB_API std::vector<MostProbDet> GetMostProbDets(
+    SparseDetection* dets, int num_dets)
+{
+  std::vector<MostProbDet> most_prob_dets;
+  for (int i = 0; i < num_dets; i++)
+  {
+    int cid = -1;
+    float max_prob = 0.0f;
+    for (int s = 0; s < dets[i].num_probs; s++)
+    {
+      ClassProb const& cp = dets[i].probs[s];
+      if (cp.prob > max_prob || (cp.prob == max_prob && cp.cid < cid))
+      {
+        cid = cp.cid;
+        max_prob = cp.prob;
+      }
+    }
+
+    if (cid != -1)
+    {
+      MostProbDet mpd;
+      mpd.bbox = dets[i].bbox;
+      mpd.cid = cid;
+      mpd.prob = max_prob;
+      most_prob_dets.push_back(mpd);
+    }
+  }
+
+  return most_prob_dets;
+}
+
+// Inserts (cid, prob) into probs kept in descending order of probability,
+// dropping the least probable entry once top_k entries are held
+void InsertClassProb(
+    ClassProb* probs, int* num_probs, int top_k, int cid, float prob)
+{
+  int n = *num_probs;
+  if (top_k <= 0 || (n == top_k && !(prob > probs[n - 1].prob)))
+    return;
+
+  int pos = n < top_k ? n : n - 1;
+  while (pos > 0 && prob > probs[pos - 1].prob)
+  {
+    probs[pos] = probs[pos - 1];
+    pos--;
+  }
+  probs[pos].cid = cid;
+  probs[pos].prob = prob;
+
+  if (n < top_k)
+    *num_probs = n + 1;
+}
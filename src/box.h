@@ -16,6 +16,9 @@ typedef enum
 {
   GREEDY_NMS,
   DIOU_NMS,
+  GRID_NMS,
+  FAST_NMS,
+  MATRIX_NMS,
 } NMS_KIND;
 
 typedef struct DxRep
@@ -84,6 +87,22 @@ typedef struct Detection
   int points;
 } Detection;
 
+typedef struct ClassProb
+{
+  int cid;
+  float prob;
+} ClassProb;
+
+// Compact alternative to Detection for many-class models, keeping only the
+// top-k classes above threshold in descending order of probability
+typedef struct SparseDetection
+{
+  Box bbox;
+  float objectness;
+  int num_probs;
+  ClassProb* probs;  // points into a pool owned by the producer
+} SparseDetection;
+
 typedef struct MostProbDet
 {
   Box bbox;
@@ -93,5 +112,12 @@ typedef struct MostProbDet
 
 LIB_API void NmsSort(Detection* dets, int total, int classes, float thresh,
     NMS_KIND nms_kind, float beta);
+LIB_API void NmsSort(SparseDetection* dets, int total, int classes,
+    float thresh, NMS_KIND nms_kind, float beta);
 
 LIB_API std::vector<MostProbDet> GetMostProbDets(Detection* dets, int num_dets);
+LIB_API std::vector<MostProbDet> GetMostProbDets(
+    SparseDetection* dets, int num_dets);
+
+void InsertClassProb(
+    ClassProb* probs, int* num_probs, int top_k, int cid, float prob);
@@ -0,0 +1,287 @@
+#include "box_batch.h"
+
+#include <float.h>
+#include <math.h>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+#include "utils.h"
+
+void BoxBatch::Clear()
+{
+  x.clear();
+  y.clear();
+  w.clear();
+  h.clear();
+  left.clear();
+  right.clear();
+  top.clear();
+  bottom.clear();
+  area.clear();
+}
+
+void BoxBatch::Reserve(int n)
+{
+  x.reserve(n);
+  y.reserve(n);
+  w.reserve(n);
+  h.reserve(n);
+  left.reserve(n);
+  right.reserve(n);
+  top.reserve(n);
+  bottom.reserve(n);
+  area.reserve(n);
+}
+
+// corners are derived with the same expressions as Box::Overlap()
+void BoxBatch::Push(Box const& b)
+{
+  x.push_back(b.x);
+  y.push_back(b.y);
+  w.push_back(b.w);
+  h.push_back(b.h);
+  left.push_back(b.x - b.w / 2);
+  right.push_back(b.x + b.w / 2);
+  top.push_back(b.y - b.h / 2);
+  bottom.push_back(b.y + b.h / 2);
+  area.push_back(b.w * b.h);
+}
+
+void BoxBatch::Assign(Box const* boxes, int n)
+{
+  Clear();
+  Reserve(n);
+  for (int i = 0; i < n; ++i)
+  {
+    Push(boxes[i]);
+  }
+}
+
+float BoxBatch::Iou(int i, int j) const
+{
+  float ow = min_val_cmp(right[i], right[j]) - max_val_cmp(left[i], left[j]);
+  float oh = min_val_cmp(bottom[i], bottom[j]) - max_val_cmp(top[i], top[j]);
+  float I = (ow < 0 || oh < 0) ? 0 : ow * oh;
+  float U = area[i] + area[j] - I;
+  if (fabs(I) < FLT_EPSILON || fabs(U) < FLT_EPSILON)
+    return 0;
+  else
+    return I / U;
+}
+
+namespace
+{
+#ifdef __AVX2__
+// Box a broadcast to all lanes
+typedef struct Lanes8
+{
+  __m256 x, y, l, r, t, b, area;
+} Lanes8;
+
+Lanes8 Broadcast8(Box const& a)
+{
+  Lanes8 v;
+  v.x = _mm256_set1_ps(a.x);
+  v.y = _mm256_set1_ps(a.y);
+  v.l = _mm256_set1_ps(a.x - a.w / 2);
+  v.r = _mm256_set1_ps(a.x + a.w / 2);
+  v.t = _mm256_set1_ps(a.y - a.h / 2);
+  v.b = _mm256_set1_ps(a.y + a.h / 2);
+  v.area = _mm256_set1_ps(a.w * a.h);
+  return v;
+}
+
+// IoU of a with boxes [j, j + 8), lane-wise identical to Box::Iou()
+__m256 Iou8(BoxBatch const& bb, Lanes8 const& a, int j, __m256* union_out)
+{
+  __m256 const zero = _mm256_setzero_ps();
+  __m256 const eps = _mm256_set1_ps(FLT_EPSILON);
+  __m256 const abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+  __m256 ow = _mm256_sub_ps(_mm256_min_ps(a.r, _mm256_loadu_ps(&bb.right[j])),
+      _mm256_max_ps(a.l, _mm256_loadu_ps(&bb.left[j])));
+  __m256 oh = _mm256_sub_ps(_mm256_min_ps(a.b, _mm256_loadu_ps(&bb.bottom[j])),
+      _mm256_max_ps(a.t, _mm256_loadu_ps(&bb.top[j])));
+  __m256 no_overlap = _mm256_or_ps(
+      _mm256_cmp_ps(ow, zero, _CMP_LT_OQ), _mm256_cmp_ps(oh, zero, _CMP_LT_OQ));
+  __m256 I = _mm256_andnot_ps(no_overlap, _mm256_mul_ps(ow, oh));
+  __m256 U =
+      _mm256_sub_ps(_mm256_add_ps(a.area, _mm256_loadu_ps(&bb.area[j])), I);
+  __m256 degenerate = _mm256_or_ps(
+      _mm256_cmp_ps(_mm256_and_ps(I, abs_mask), eps, _CMP_LT_OQ),
+      _mm256_cmp_ps(_mm256_and_ps(U, abs_mask), eps, _CMP_LT_OQ));
+
+  if (union_out)
+    *union_out = U;
+  return _mm256_andnot_ps(degenerate, _mm256_div_ps(I, U));
+}
+
+// Width and height of the smallest box enclosing a and boxes [j, j + 8)
+void Enclose8(
+    BoxBatch const& bb, Lanes8 const& a, int j, __m256* cw, __m256* ch)
+{
+  *cw = _mm256_sub_ps(_mm256_max_ps(a.r, _mm256_loadu_ps(&bb.right[j])),
+      _mm256_min_ps(a.l, _mm256_loadu_ps(&bb.left[j])));
+  *ch = _mm256_sub_ps(_mm256_max_ps(a.b, _mm256_loadu_ps(&bb.bottom[j])),
+      _mm256_min_ps(a.t, _mm256_loadu_ps(&bb.top[j])));
+}
+#endif
+
+#ifdef __AVX512F__
+// 16-lane counterpart of Iou8()
+__m512 Iou16(BoxBatch const& bb, Box const& a, int j)
+{
+  __m512 const zero = _mm512_setzero_ps();
+  __m512 const eps = _mm512_set1_ps(FLT_EPSILON);
+  __m512 const l = _mm512_set1_ps(a.x - a.w / 2);
+  __m512 const r = _mm512_set1_ps(a.x + a.w / 2);
+  __m512 const t = _mm512_set1_ps(a.y - a.h / 2);
+  __m512 const b = _mm512_set1_ps(a.y + a.h / 2);
+
+  __m512 ow = _mm512_sub_ps(_mm512_min_ps(r, _mm512_loadu_ps(&bb.right[j])),
+      _mm512_max_ps(l, _mm512_loadu_ps(&bb.left[j])));
+  __m512 oh = _mm512_sub_ps(_mm512_min_ps(b, _mm512_loadu_ps(&bb.bottom[j])),
+      _mm512_max_ps(t, _mm512_loadu_ps(&bb.top[j])));
+  __mmask16 overlap = _mm512_cmp_ps_mask(ow, zero, _CMP_NLT_UQ) &
+                      _mm512_cmp_ps_mask(oh, zero, _CMP_NLT_UQ);
+  __m512 I = _mm512_maskz_mul_ps(overlap, ow, oh);
+  __m512 const area = _mm512_set1_ps(a.w * a.h);
+  __m512 U =
+      _mm512_sub_ps(_mm512_add_ps(area, _mm512_loadu_ps(&bb.area[j])), I);
+  __mmask16 valid = _mm512_cmp_ps_mask(_mm512_abs_ps(I), eps, _CMP_NLT_UQ) &
+                    _mm512_cmp_ps_mask(_mm512_abs_ps(U), eps, _CMP_NLT_UQ);
+  return _mm512_maskz_div_ps(valid, I, U);
+}
+#endif
+}  // namespace
+
+void BoxBatch::Iou(Box const& a, int start, int end, float* out,
+    IOU_LOSS iou_type, float beta) const
+{
+  int j = start;
+#ifdef __AVX512F__
+  if (iou_type == IOU)
+  {
+    for (; j + 16 <= end; j += 16)
+    {
+      _mm512_storeu_ps(&out[j - start], Iou16(*this, a, j));
+    }
+  }
+#endif
+#ifdef __AVX2__
+  if (iou_type == IOU || iou_type == GIOU || iou_type == DIOU)
+  {
+    __m256 const eps = _mm256_set1_ps(FLT_EPSILON);
+    __m256 const abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    Lanes8 const va = Broadcast8(a);
+    for (; j + 8 <= end; j += 8)
+    {
+      __m256 U;
+      __m256 iou = Iou8(*this, va, j, &U);
+      if (iou_type == IOU)
+      {
+        _mm256_storeu_ps(&out[j - start], iou);
+        continue;
+      }
+
+      __m256 cw, ch;
+      Enclose8(*this, va, j, &cw, &ch);
+      if (iou_type == GIOU)
+      {
+        // iou - (c - u) / c, or iou when the enclosing box is degenerate
+        __m256 c = _mm256_mul_ps(cw, ch);
+        __m256 giou = _mm256_sub_ps(iou, _mm256_div_ps(_mm256_sub_ps(c, U), c));
+        __m256 degenerate =
+            _mm256_cmp_ps(_mm256_and_ps(c, abs_mask), eps, _CMP_LT_OQ);
+        _mm256_storeu_ps(
+            &out[j - start], _mm256_blendv_ps(giou, iou, degenerate));
+        continue;
+      }
+
+      // DIoU: squared diagonal and center distance in lanes, pow() in scalar
+      __m256 c = _mm256_add_ps(_mm256_mul_ps(cw, cw), _mm256_mul_ps(ch, ch));
+      __m256 dx = _mm256_sub_ps(va.x, _mm256_loadu_ps(&x[j]));
+      __m256 dy = _mm256_sub_ps(va.y, _mm256_loadu_ps(&y[j]));
+      __m256 d = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+
+      float iou_k[8], c_k[8], d_k[8];
+      _mm256_storeu_ps(iou_k, iou);
+      _mm256_storeu_ps(c_k, c);
+      _mm256_storeu_ps(d_k, d);
+      for (int k = 0; k < 8; ++k)
+      {
+        if (fabs(c_k[k]) < FLT_EPSILON)
+        {
+          out[j + k - start] = iou_k[k];
+          continue;
+        }
+
+        float diou_term = pow(d_k[k] / c_k[k], beta);
+        out[j + k - start] = iou_k[k] - diou_term;
+      }
+    }
+  }
+#endif
+  for (; j < end; ++j)
+  {
+    if (iou_type == DIOU)
+      out[j - start] = Box::Diou(a, Get(j), beta);
+    else
+      out[j - start] = Box::Iou(a, Get(j), iou_type);
+  }
+}
+
+void BoxBatch::FlagIou(
+    Box const& a, int start, int end, float thresh, char* flags) const
+{
+  int j = start;
+#ifdef __AVX512F__
+  __m512 const th16 = _mm512_set1_ps(thresh);
+  for (; j + 16 <= end; j += 16)
+  {
+    __mmask16 over =
+        _mm512_cmp_ps_mask(Iou16(*this, a, j), th16, _CMP_GT_OQ);
+    while (over)
+    {
+      int k = __builtin_ctz(over);
+      flags[j + k] = 1;
+      over &= over - 1;
+    }
+  }
+#endif
+#ifdef __AVX2__
+  __m256 const th = _mm256_set1_ps(thresh);
+  Lanes8 const va = Broadcast8(a);
+  for (; j + 8 <= end; j += 8)
+  {
+    __m256 iou = Iou8(*this, va, j, nullptr);
+    int over = _mm256_movemask_ps(_mm256_cmp_ps(iou, th, _CMP_GT_OQ));
+    while (over)
+    {
+      int k = __builtin_ctz(over);
+      flags[j + k] = 1;
+      over &= over - 1;
+    }
+  }
+#endif
+  for (; j < end; ++j)
+  {
+    if (Box::Iou(a, Get(j)) > thresh)
+      flags[j] = 1;
+  }
+}
+
+void IouMatrix(BoxBatch const& a, BoxBatch const& b, float* out,
+    IOU_LOSS iou_type, float beta)
+{
+  int const rows = a.Size();
+  int const cols = b.Size();
+
+#pragma omp parallel for if (rows * cols > 16384)
+  for (int i = 0; i < rows; ++i)
+  {
+    b.Iou(a.Get(i), 0, cols, &out[(size_t)i * cols], iou_type, beta);
+  }
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <vector>
+
+#include "box.h"
+#include "libapi.h"
+
+// Boxes in structure-of-arrays layout for the batched IoU kernels. Results
+// follow the arithmetic of the scalar Box functions step by step; IoU runs on
+// AVX-512 or AVX2, GIoU and the geometry of DIoU on AVX2, while the pow() of
+// DIoU and the whole of CIoU and MSE stay scalar per lane.
+class LIB_API BoxBatch
+{
+ public:
+  void Clear();
+  void Reserve(int n);
+  void Push(Box const& b);
+  void Assign(Box const* boxes, int n);
+
+  int Size() const { return (int)x.size(); }
+  Box Get(int i) const { return Box(x[i], y[i], w[i], h[i]); }
+
+  // Writes the iou_type similarity of a with boxes [start, end) to
+  // out[0, end - start); beta is the DIoU exponent
+  void Iou(Box const& a, int start, int end, float* out,
+      IOU_LOSS iou_type = IOU, float beta = 0.6f) const;
+
+  // same arithmetic as Box::Iou(Get(i), Get(j))
+  float Iou(int i, int j) const;
+
+  // Flags every box in [start, end) whose IoU with a exceeds thresh
+  void FlagIou(
+      Box const& a, int start, int end, float thresh, char* flags) const;
+
+ public:
+  std::vector<float> x, y, w, h;
+  std::vector<float> left, right, top, bottom, area;
+};
+
+// Many-vs-many: out[i * b.Size() + j] is the similarity of a[i] and b[j]
+LIB_API void IouMatrix(BoxBatch const& a, BoxBatch const& b, float* out,
+    IOU_LOSS iou_type = IOU, float beta = 0.6f);
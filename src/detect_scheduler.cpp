@@ -0,0 +1,56 @@
+#include "detect_scheduler.h"
+
+#include <float.h>
+
+#include "utils.h"
+
+namespace yc
+{
+DetectScheduler::DetectScheduler(
+    int max_interval, float min_iou, float max_drift)
+    : max_interval_(max_val_cmp(max_interval, 1)),
+      min_iou_(min_iou),
+      max_drift_(max_drift),
+      interval_(1),
+      since_detect_(0),
+      num_frames_(0),
+      num_detections_(0)
+{
+}
+
+bool DetectScheduler::Step()
+{
+  num_frames_++;
+  if (num_frames_ > 1 && ++since_detect_ < interval_)
+    return false;
+
+  since_detect_ = 0;
+  num_detections_++;
+  return true;
+}
+
+void DetectScheduler::Update(TrackStats const& stats)
+{
+  // new tracks need consecutive detections to be confirmed
+  if (stats.num_new > 0 || stats.num_lost > 0)
+    interval_ = 1;
+  else if (stats.mean_iou < min_iou_)
+    interval_ = max_val_cmp(interval_ / 2, 1);
+  else
+    interval_++;
+
+  float drift_bound = max_drift_ / max_val_cmp(stats.max_speed, FLT_EPSILON);
+  if (drift_bound < interval_)
+    interval_ = max_val_cmp((int)drift_bound, 1);
+
+  interval_ = min_val_cmp(interval_, max_interval_);
+}
+
+double DetectScheduler::DutyCycle() const
+{
+  if (num_frames_ == 0)
+    return 1.0;
+
+  return (double)num_detections_ / num_frames_;
+}
+}  // namespace yc
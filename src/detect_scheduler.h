@@ -0,0 +1,43 @@
+#pragma once
+#include "libapi.h"
+#include "track_manager.h"
+
+namespace yc
+{
+// Decides on which frames the detector runs, the frames in between being
+// covered by TrackManager::Propagate(). The interval grows by one while
+// detections keep confirming the propagated tracks, drops back to every frame
+// as soon as tracks appear or end, halves when predictions drift off the
+// detections, and never exceeds max_interval or lets a track move more than
+// max_drift box sizes unobserved.
+class LIB_API DetectScheduler
+{
+ public:
+  DetectScheduler(int max_interval = 1, float min_iou = 0.5f,
+      float max_drift = 0.5f);
+
+  // Counts a frame; true if the detector should run on it
+  bool Step();
+
+  // Adapts the interval after a detector frame went through TrackManager
+  void Update(TrackStats const& stats);
+
+  int Interval() const { return interval_; }
+  long long NumFrames() const { return num_frames_; }
+  long long NumDetections() const { return num_detections_; }
+
+  // fraction of frames that ran the detector
+  double DutyCycle() const;
+
+ private:
+  int max_interval_;
+  float min_iou_;
+  float max_drift_;
+
+  int interval_;
+  int since_detect_;
+
+  long long num_frames_;
+  long long num_detections_;
+};
+}  // namespace yc
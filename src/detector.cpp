@@ -2,6 +2,7 @@
 #include <stdlib.h>
 
 #include "box.h"
+#include "box_batch.h"
 #include "cost_layer.h"
 #include "image.h"
 #include "image_opencv.h"
@@ -385,8 +386,17 @@ float ValidateDetector(Metadata const& md, Network* net, float const iou_thresh)
       num_gt_class[gt[k].id]++;
     }
 
+    BoxBatch gt_boxes;
+    for (size_t k = 0; k < gt.size(); ++k)
+    {
+      gt_boxes.Push(Box(gt[k].x, gt[k].y, gt[k].w, gt[k].h));
+    }
+
+    std::vector<float> ious(gt.size());
     for (int j = 0; j < num_boxes; ++j)
     {
+      // IoU with every ground truth, computed once per box for all classes
+      bool has_ious = false;
       for (int cid = 0; cid < classes; ++cid)
       {
         Box pred_box = dets[j].bbox;
@@ -396,12 +406,17 @@ float ValidateDetector(Metadata const& md, Network* net, float const iou_thresh)
 
         num_pred_class[cid]++;
 
+        if (!has_ious)
+        {
+          gt_boxes.Iou(pred_box, 0, gt_boxes.Size(), ious.data());
+          has_ious = true;
+        }
+
         int gt_idx = -1;
         float max_iou = 0;
         for (size_t k = 0; k < gt.size(); ++k)
         {
-          Box gt_box(gt[k].x, gt[k].y, gt[k].w, gt[k].h);
-          float iou = Box::Iou(pred_box, gt_box);
+          float iou = ious[k];
           if (iou > iou_thresh && iou > max_iou && cid == gt[k].id)
           {
             max_iou = iou;
@@ -2,6 +2,10 @@
 
 #include <tinyxml2.h>
 
+#include <algorithm>
+#include <map>
+#include <set>
+
 #include "utils.h"
 
 namespace yc
@@ -167,12 +171,14 @@ void PolyInfo::Draw(cv::Mat& img, char const* msg) const
 
 void PolyInfo::Proc(std::vector<yc::Track*>& tracks) {}
 
-Handover::Handover(std::string name, Polygon const& poly) : PolyInfo(name, poly)
+Handover::Handover(std::string name, Polygon const& poly)
+    : PolyInfo(name, poly), window_(0), frame_(0)
 {
 }
 
 void Handover::Proc(std::vector<yc::Track*>& tracks)
 {
+  frame_++;
   for (size_t i = 0; i < tracks.size(); i++)
   {
     Box box = tracks[i]->GetBox();
@@ -181,7 +187,7 @@ void Handover::Proc(std::vector<yc::Track*>& tracks)
     if (area_i / (box.w * box.h) > 0.5f)
     {
       if (!tracks[i]->GetEnterStatus() &&
-          tracks[i]->GetCount() < Track::GetFps() * 2)
+          tracks[i]->GetCount() < tracks[i]->GetFps() * 2)
         UniquePushBack(enter_, tracks[i]);
       else if (!tracks[i]->GetExitStatus())
         UniquePushBack(exit_, tracks[i]);
@@ -189,43 +195,30 @@ void Handover::Proc(std::vector<yc::Track*>& tracks)
   }
 }
 
-void Handover::Crosstalk(Handover* h1, Handover* h2)
+void Handover::Refresh(std::vector<std::pair<int, yc::Track*>> const& live)
 {
-  if (!h1->exit_.empty() && !h2->enter_.empty())
+  std::deque<HandoverEvent>* queues[] = {&exit_, &enter_};
+  for (int q = 0; q < 2; q++)
   {
-    int label = h1->exit_.front()->GetLabel();
-    if (label != -1)
+    for (size_t i = 0; i < queues[q]->size(); i++)
     {
-      h2->enter_.front()->SetLabel(label);
-      h2->enter_.front()->SetEnterStatus(true);
-      h1->exit_.front()->SetExitStatus(true);
-
-      h1->exit_.pop_front();
-      h2->enter_.pop_front();
-    }
-  }
-
-  if (!h2->exit_.empty() && !h1->enter_.empty())
-  {
-    int label = h2->exit_.front()->GetLabel();
-    if (label != -1)
-    {
-      h1->enter_.front()->SetLabel(label);
-      h1->enter_.front()->SetEnterStatus(true);
-      h2->exit_.front()->SetExitStatus(true);
-
-      h2->exit_.pop_front();
-      h1->enter_.pop_front();
+      HandoverEvent& e = (*queues[q])[i];
+      std::vector<std::pair<int, yc::Track*>>::const_iterator it =
+          std::lower_bound(live.begin(), live.end(),
+              std::make_pair(e.id, (yc::Track*)nullptr));
+      e.track = it != live.end() && it->first == e.id ? it->second : nullptr;
+      if (e.track != nullptr)
+        e.label = e.track->GetLabel();
     }
   }
 }
 
-void Handover::UniquePushBack(std::deque<yc::Track*>& q, yc::Track* track)
+void Handover::UniquePushBack(std::deque<HandoverEvent>& q, yc::Track* track)
 {
   bool exist = false;
   for (size_t i = 0; i < q.size(); i++)
   {
-    if (q[i] == track)
+    if (q[i].id == track->GetId())
     {
       exist = true;
       break;
@@ -233,7 +226,11 @@ void Handover::UniquePushBack(std::deque<yc::Track*>& q, yc::Track* track)
   }
 
   if (!exist)
-    q.push_back(track);
+  {
+    HandoverEvent e = {
+        track, track->GetId(), track->GetLabel(), frame_, false};
+    q.push_back(e);
+  }
 }
 
 ParkingLot::ParkingLot(std::string name, Polygon const& poly)
@@ -290,6 +287,183 @@ void ParkingLot::Proc(std::vector<yc::Track*>& tracks)
   }
 }
 
+ZoneIndex::ZoneIndex()
+    : left_(0),
+      top_(0),
+      right_(0),
+      bottom_(0),
+      cell_w_(1),
+      cell_h_(1),
+      cols_(0),
+      rows_(0)
+{
+}
+
+void ZoneIndex::BuildGrid(std::vector<PolyInfo*> const& zones)
+{
+  cols_ = rows_ = 0;
+  cell_start_.clear();
+  items_.clear();
+  if (zones.empty())
+    return;
+
+  left_ = top_ = FLT_MAX;
+  right_ = bottom_ = -FLT_MAX;
+  for (size_t i = 0; i < zones.size(); i++)
+  {
+    Box const& b = zones[i]->BBox();
+    left_ = min_val_cmp(left_, b.x - b.w / 2);
+    top_ = min_val_cmp(top_, b.y - b.h / 2);
+    right_ = max_val_cmp(right_, b.x + b.w / 2);
+    bottom_ = max_val_cmp(bottom_, b.y + b.h / 2);
+  }
+
+  // about one zone per cell
+  int side = (int)ceil(sqrt((double)zones.size()));
+  cols_ = rows_ = max_val_cmp(1, min_val_cmp(side, 64));
+  cell_w_ = max_val_cmp((right_ - left_) / cols_, FLT_EPSILON);
+  cell_h_ = max_val_cmp((bottom_ - top_) / rows_, FLT_EPSILON);
+
+  // bucket the zones by cell, counting first
+  cell_start_.assign(cols_ * rows_ + 1, 0);
+  for (int pass = 0; pass < 2; pass++)
+  {
+    std::vector<int> fill(cell_start_.begin(), cell_start_.end() - 1);
+    for (int i = 0; i < (int)zones.size(); i++)
+    {
+      Box const& b = zones[i]->BBox();
+      int x0, y0, x1, y1;
+      CellRange(b.x - b.w / 2, b.y - b.h / 2, b.x + b.w / 2, b.y + b.h / 2,
+          x0, y0, x1, y1);
+      for (int y = y0; y <= y1; y++)
+      {
+        for (int x = x0; x <= x1; x++)
+        {
+          if (pass == 0)
+            cell_start_[y * cols_ + x + 1]++;
+          else
+            items_[fill[y * cols_ + x]++] = i;
+        }
+      }
+    }
+
+    if (pass == 0)
+    {
+      for (int c = 0; c < cols_ * rows_; c++)
+      {
+        cell_start_[c + 1] += cell_start_[c];
+      }
+      items_.resize(cell_start_.back());
+    }
+  }
+}
+
+// Each zone is filled, grown by a pixel so that no point inside it is missed
+// at its border, and pixels reached by several zones are marked as shared
+void ZoneIndex::BuildRaster(std::vector<PolyInfo*> const& zones, int size)
+{
+  raster_.release();
+  if (size <= 0)
+    return;
+
+  raster_ = cv::Mat(size, size, CV_32SC1, cv::Scalar(kNoZone));
+  cv::Mat mask(size, size, CV_8UC1);
+  cv::Mat kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3, 3));
+  for (int i = 0; i < (int)zones.size(); i++)
+  {
+    Polygon const& poly = zones[i]->Poly();
+    std::vector<cv::Point> scaled(poly.size());
+    for (size_t j = 0; j < poly.size(); j++)
+    {
+      scaled[j].x = int(poly[j].x * size);
+      scaled[j].y = int(poly[j].y * size);
+    }
+
+    mask.setTo(0);
+    cv::fillPoly(mask, std::vector<std::vector<cv::Point>>(1, scaled), 255);
+    cv::dilate(mask, mask, kernel);
+
+    for (int y = 0; y < size; y++)
+    {
+      uchar const* m = mask.ptr<uchar>(y);
+      int* r = raster_.ptr<int>(y);
+      for (int x = 0; x < size; x++)
+      {
+        if (m[x])
+          r[x] = r[x] == kNoZone ? i : kSharedZone;
+      }
+    }
+  }
+}
+
+void ZoneIndex::CellRange(float l, float t, float r, float b, int& x0,
+    int& y0, int& x1, int& y1) const
+{
+  x0 = (int)max_val_cmp(0.0f, (l - left_) / cell_w_);
+  y0 = (int)max_val_cmp(0.0f, (t - top_) / cell_h_);
+  x1 = (int)min_val_cmp(cols_ - 1.0f, (r - left_) / cell_w_);
+  y1 = (int)min_val_cmp(rows_ - 1.0f, (b - top_) / cell_h_);
+}
+
+void ZoneIndex::Query(cv::Point2f pt, std::vector<int>& zones) const
+{
+  zones.clear();
+  if (cols_ == 0 || pt.x < left_ || pt.x > right_ || pt.y < top_ ||
+      pt.y > bottom_)
+    return;
+
+  int x0, y0, x1, y1;
+  CellRange(pt.x, pt.y, pt.x, pt.y, x0, y0, x1, y1);
+
+  int c = y0 * cols_ + x0;
+  for (int k = cell_start_[c]; k < cell_start_[c + 1]; k++)
+  {
+    zones.push_back(items_[k]);
+  }
+}
+
+void ZoneIndex::Query(Box const& box, std::vector<int>& zones) const
+{
+  zones.clear();
+  float l = box.x - box.w / 2, r = box.x + box.w / 2;
+  float t = box.y - box.h / 2, b = box.y + box.h / 2;
+  if (cols_ == 0 || r < left_ || l > right_ || b < top_ || t > bottom_)
+    return;
+
+  int x0, y0, x1, y1;
+  CellRange(l, t, r, b, x0, y0, x1, y1);
+  for (int y = y0; y <= y1; y++)
+  {
+    for (int x = x0; x <= x1; x++)
+    {
+      int c = y * cols_ + x;
+      zones.insert(zones.end(), items_.begin() + cell_start_[c],
+          items_.begin() + cell_start_[c + 1]);
+    }
+  }
+
+  if (x0 != x1 || y0 != y1)
+  {
+    std::sort(zones.begin(), zones.end());
+    zones.erase(std::unique(zones.begin(), zones.end()), zones.end());
+  }
+}
+
+int ZoneIndex::Lookup(cv::Point2f pt) const
+{
+  if (raster_.empty())
+    return kSharedZone;
+
+  int x = (int)(pt.x * raster_.cols);
+  int y = (int)(pt.y * raster_.rows);
+  if (x < 0 || y < 0 || x >= raster_.cols || y >= raster_.rows)
+    return kNoZone;
+
+  return raster_.at<int>(y, x);
+}
+///
+
+///
 GeoInfo::~GeoInfo()
 {
   for (size_t i = 0; i < parking_lots.size(); i++)
@@ -303,7 +477,7 @@ GeoInfo::~GeoInfo()
   }
 }
 
-void GeoInfo::Load(std::string xml_path)
+void GeoInfo::Load(std::string xml_path, int raster_size)
 {
   tinyxml2::XMLDocument xml_doc;
   if (xml_doc.LoadFile(xml_path.c_str()) != tinyxml2::XML_SUCCESS)
@@ -331,12 +505,38 @@ void GeoInfo::Load(std::string xml_path)
     }
 
     if (name.find_first_of("P") == 0)
+    {
       parking_lots.push_back(new ParkingLot(name, poly));
+    }
     else if (name == "HANDOVER")
-      handovers.push_back(new Handover(name, poly));
+    {
+      Handover* handover = new Handover(name, poly);
+
+      tinyxml2::XMLElement* elem = polygon->FirstChildElement("id");
+      if (elem != nullptr && elem->GetText() != nullptr)
+        handover->id_ = elem->GetText();
+
+      elem = polygon->FirstChildElement("link");
+      while (elem != nullptr)
+      {
+        if (elem->GetText() != nullptr)
+          handover->links_.push_back(elem->GetText());
+        elem = elem->NextSiblingElement("link");
+      }
+
+      elem = polygon->FirstChildElement("window");
+      if (elem != nullptr)
+        handover->window_ = elem->FloatText();
+
+      handovers.push_back(handover);
+    }
 
     polygon = polygon->NextSiblingElement();
   }
+
+  lot_index_.Build(parking_lots);
+  lot_index_.Rasterize(parking_lots, raster_size);
+  handover_index_.Build(handovers);
 }
 
 void GeoInfo::Draw(cv::Mat& img) const
@@ -352,19 +552,237 @@ void GeoInfo::Draw(cv::Mat& img) const
   }
 }
 
+// Every zone still runs its Proc() each frame, but only with the tracks the
+// indices place in or over it
 void GeoInfo::Proc(std::vector<yc::Track*>& tracks)
 {
+  std::vector<std::vector<yc::Track*>> lot_tracks(parking_lots.size());
+  std::vector<std::vector<yc::Track*>> handover_tracks(handovers.size());
+
+  std::vector<int> zones;
+  for (size_t i = 0; i < tracks.size(); i++)
+  {
+    Box box = tracks[i]->GetBox();
+    cv::Point2f center(box.x, box.y);
+
+    int lot = lot_index_.Lookup(center);
+    if (lot >= 0)
+      lot_tracks[lot].push_back(tracks[i]);
+    else if (lot == ZoneIndex::kSharedZone)
+      lot_index_.Query(center, zones);
+    else
+      zones.clear();
+
+    for (size_t k = 0; k < zones.size() && lot < 0; k++)
+    {
+      lot_tracks[zones[k]].push_back(tracks[i]);
+    }
+
+    handover_index_.Query(box, zones);
+    for (size_t k = 0; k < zones.size(); k++)
+    {
+      handover_tracks[zones[k]].push_back(tracks[i]);
+    }
+  }
+
   for (size_t i = 0; i < parking_lots.size(); i++)
   {
-    parking_lots[i]->Proc(tracks);
+    parking_lots[i]->Proc(lot_tracks[i]);
+  }
+
+  // one id lookup of the live tracks for all regions
+  std::vector<std::pair<int, yc::Track*>> live;
+  if (!handovers.empty())
+  {
+    for (size_t i = 0; i < tracks.size(); i++)
+    {
+      live.push_back(std::make_pair(tracks[i]->GetId(), tracks[i]));
+    }
+    std::sort(live.begin(), live.end());
   }
 
   for (size_t i = 0; i < handovers.size(); i++)
   {
-    handovers[i]->Proc(tracks);
+    handovers[i]->Refresh(live);
+    handovers[i]->Proc(handover_tracks[i]);
   }
 }
 
 int GeoInfo::NumHandoverRegions() const { return (int)handovers.size(); }
 Handover* GeoInfo::GetHandoverRegion(int idx) { return handovers[idx]; }
-}  // namespace yc
\ No newline at end of file
+
+Box GeoInfo::ZoneBounds(float margin) const
+{
+  std::vector<PolyInfo const*> zones(parking_lots.begin(), parking_lots.end());
+  zones.insert(zones.end(), handovers.begin(), handovers.end());
+  if (zones.empty())
+    return Box();
+
+  float left = 1.0f, top = 1.0f, right = 0.0f, bottom = 0.0f;
+  for (size_t i = 0; i < zones.size(); i++)
+  {
+    Box const& b = zones[i]->BBox();
+    left = std::min(left, b.x - b.w / 2);
+    top = std::min(top, b.y - b.h / 2);
+    right = std::max(right, b.x + b.w / 2);
+    bottom = std::max(bottom, b.y + b.h / 2);
+  }
+
+  left = std::max(left - margin, 0.0f);
+  top = std::max(top - margin, 0.0f);
+  right = std::min(right + margin, 1.0f);
+  bottom = std::min(bottom + margin, 1.0f);
+  if (right <= left || bottom <= top)
+    return Box();
+
+  return Box((left + right) / 2, (top + bottom) / 2, right - left,
+      bottom - top);
+}
+///
+
+///
+void HandoverGraph::Build(
+    std::vector<GeoInfo>& geo_infos, double fps, double default_window)
+{
+  regions_.clear();
+  links_.clear();
+  windows_.clear();
+
+  std::map<std::string, int> ids;
+  std::vector<int> first_region(geo_infos.size() + 1, 0);
+  for (size_t c = 0; c < geo_infos.size(); c++)
+  {
+    first_region[c] = (int)regions_.size();
+    for (int r = 0; r < geo_infos[c].NumHandoverRegions(); r++)
+    {
+      Handover* h = geo_infos[c].GetHandoverRegion(r);
+      if (h->id_.empty())
+        h->id_ = std::to_string(c) + ":" + std::to_string(r);
+
+      if (ids.count(h->id_))
+        fprintf(stderr, "Duplicate handover id %s\n", h->id_.c_str());
+
+      ids[h->id_] = (int)regions_.size();
+      regions_.push_back(h);
+
+      double window = h->window_ > 0 ? h->window_ : default_window;
+      windows_.push_back((int64_t)(window * fps + 0.5));
+    }
+  }
+  first_region[geo_infos.size()] = (int)regions_.size();
+
+  // undirected edges, each stored once
+  std::set<std::pair<int, int>> edges;
+  for (int i = 0; i < (int)regions_.size(); i++)
+  {
+    for (size_t k = 0; k < regions_[i]->links_.size(); k++)
+    {
+      std::map<std::string, int>::const_iterator it =
+          ids.find(regions_[i]->links_[k]);
+      if (it == ids.end())
+      {
+        fprintf(stderr, "Unknown handover link %s of %s\n",
+            regions_[i]->links_[k].c_str(), regions_[i]->id_.c_str());
+        continue;
+      }
+
+      if (it->second != i)
+        edges.insert(std::make_pair(
+            min_val_cmp(i, it->second), max_val_cmp(i, it->second)));
+    }
+  }
+
+  if (edges.empty() && geo_infos.size() == 2 &&
+      geo_infos[0].NumHandoverRegions() > 1 &&
+      geo_infos[1].NumHandoverRegions() > 0)
+    edges.insert(std::make_pair(first_region[0] + 1, first_region[1]));
+
+  links_.assign(edges.begin(), edges.end());
+}
+
+void HandoverGraph::Match()
+{
+  typedef struct Candidate
+  {
+    int64_t gap;
+    int exit_region, exit_idx;
+    int enter_region, enter_idx;
+  } Candidate;
+
+  // exits become eligible once their track is labelled, and stay so after
+  // the track is gone; enters need their track alive to take the label
+  std::vector<Candidate> cands;
+  for (size_t l = 0; l < links_.size(); l++)
+  {
+    for (int dir = 0; dir < 2; dir++)
+    {
+      int a = dir == 0 ? links_[l].first : links_[l].second;
+      int b = dir == 0 ? links_[l].second : links_[l].first;
+      int64_t window = min_val_cmp(windows_[a], windows_[b]);
+
+      std::deque<HandoverEvent> const& exits = regions_[a]->exit_;
+      std::deque<HandoverEvent> const& enters = regions_[b]->enter_;
+      for (int i = 0; i < (int)exits.size(); i++)
+      {
+        if (exits[i].label == -1)
+          continue;
+
+        for (int j = 0; j < (int)enters.size(); j++)
+        {
+          if (enters[j].track == nullptr)
+            continue;
+
+          int64_t gap = enters[j].frame - exits[i].frame;
+          if (gap < 0)
+            gap = -gap;
+          if (gap > window)
+            continue;
+
+          Candidate c = {gap, a, i, b, j};
+          cands.push_back(c);
+        }
+      }
+    }
+  }
+
+  std::sort(cands.begin(), cands.end(),
+      [](Candidate const& c1, Candidate const& c2) { return c1.gap < c2.gap; });
+
+  // closest in time first
+  for (size_t k = 0; k < cands.size(); k++)
+  {
+    Candidate const& c = cands[k];
+    HandoverEvent& leaving = regions_[c.exit_region]->exit_[c.exit_idx];
+    HandoverEvent& entering = regions_[c.enter_region]->enter_[c.enter_idx];
+    if (leaving.matched || entering.matched)
+      continue;
+
+    entering.track->SetLabel(leaving.label);
+    entering.track->SetEnterStatus(true);
+    if (leaving.track != nullptr)
+      leaving.track->SetExitStatus(true);
+
+    leaving.matched = true;
+    entering.matched = true;
+  }
+
+  // drop matched events and those past their window
+  for (size_t r = 0; r < regions_.size(); r++)
+  {
+    Handover* h = regions_[r];
+    int64_t oldest = h->frame_ - windows_[r];
+    std::deque<HandoverEvent>* queues[] = {&h->exit_, &h->enter_};
+    for (int q = 0; q < 2; q++)
+    {
+      std::deque<HandoverEvent> kept;
+      for (size_t i = 0; i < queues[q]->size(); i++)
+      {
+        HandoverEvent const& e = (*queues[q])[i];
+        if (!e.matched && e.frame >= oldest)
+          kept.push_back(e);
+      }
+      queues[q]->swap(kept);
+    }
+  }
+}
+}  // namespace yc
@@ -1,8 +1,11 @@
 
+#include <stdint.h>
+
 #include <ctime>
 #include <deque>
 #include <opencv2/opencv.hpp>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "box.h"
@@ -29,6 +32,8 @@ class PolyInfo
   PolyInfo(std::string name, Polygon const& poly);
 
   std::string Name() const;
+  Polygon const& Poly() const { return poly_; }
+  Box const& BBox() const { return bbox_; }
 
   bool IsInPolygon(cv::Point2f pt) const;
   virtual void Draw(cv::Mat& img, char const* msg = nullptr) const;
@@ -40,6 +45,19 @@ class PolyInfo
   Box bbox_;
 };
 
+// Track seen entering or leaving a handover region, stamped with the frame.
+// Events outlive their tracks, so they hold the track id and the last label;
+// track points to the live track of that id in the current frame only and is
+// null once the manager no longer reports it.
+struct HandoverEvent
+{
+  yc::Track* track;
+  int id;
+  int label;
+  int64_t frame;
+  bool matched;
+};
+
 class Handover : public PolyInfo
 {
  public:
@@ -47,13 +65,23 @@ class Handover : public PolyInfo
 
   virtual void Proc(std::vector<yc::Track*>& tracks);
 
-  static void Crosstalk(Handover* h1, Handover* h2);
+  // Points the events at the tracks of the frame, all of the camera and not
+  // only those inside the region, given as (id, track) pairs sorted by id
+  void Refresh(std::vector<std::pair<int, yc::Track*>> const& live);
+
+ public:
+  // graph settings from the XML; an empty id is filled in by HandoverGraph
+  std::string id_;
+  std::vector<std::string> links_;
+  double window_;  // seconds, <= 0 for the graph default
 
  protected:
-  void UniquePushBack(std::deque<yc::Track*>& q, yc::Track* track);
+  friend class HandoverGraph;
+  void UniquePushBack(std::deque<HandoverEvent>& q, yc::Track* track);
 
-  std::deque<yc::Track*> enter_;
-  std::deque<yc::Track*> exit_;
+  int64_t frame_;
+  std::deque<HandoverEvent> enter_;
+  std::deque<HandoverEvent> exit_;
 };
 
 class ParkingLot : public PolyInfo
@@ -69,12 +97,64 @@ class ParkingLot : public PolyInfo
   std::vector<Occ> occupations_;
 };
 
+// Uniform grid over the bounding boxes of zones, so a track is only tested
+// against the zones it can touch. The optional raster labels each pixel with
+// the only zone covering it, or as shared by several.
+class ZoneIndex
+{
+ public:
+  enum
+  {
+    kNoZone = -1,
+    kSharedZone = -2
+  };
+
+  ZoneIndex();
+
+  template <typename Zone>
+  void Build(std::vector<Zone*> const& zones)
+  {
+    std::vector<PolyInfo*> polys(zones.begin(), zones.end());
+    BuildGrid(polys);
+  }
+
+  template <typename Zone>
+  void Rasterize(std::vector<Zone*> const& zones, int size)
+  {
+    std::vector<PolyInfo*> polys(zones.begin(), zones.end());
+    BuildRaster(polys, size);
+  }
+
+  // Zones whose bounding box contains pt or overlaps box, each listed once
+  void Query(cv::Point2f pt, std::vector<int>& zones) const;
+  void Query(Box const& box, std::vector<int>& zones) const;
+
+  // Zone of the raster pixel under pt, kNoZone or kSharedZone; kSharedZone
+  // too without a raster
+  int Lookup(cv::Point2f pt) const;
+
+ private:
+  void BuildGrid(std::vector<PolyInfo*> const& zones);
+  void BuildRaster(std::vector<PolyInfo*> const& zones, int size);
+  void CellRange(float l, float t, float r, float b, int& x0, int& y0,
+      int& x1, int& y1) const;
+
+  float left_, top_, right_, bottom_;
+  float cell_w_, cell_h_;
+  int cols_, rows_;
+  std::vector<int> cell_start_;
+  std::vector<int> items_;
+
+  cv::Mat raster_;  // CV_32SC1 zone ids
+};
+
 class GeoInfo
 {
  public:
   ~GeoInfo();
 
-  void Load(std::string xml_path);
+  // raster_size > 0 also rasterizes the parking lots at that resolution
+  void Load(std::string xml_path, int raster_size = 0);
 
   void Draw(cv::Mat& img) const;
   void Proc(std::vector<yc::Track*>& tracks);
@@ -82,8 +162,39 @@ class GeoInfo
   int NumHandoverRegions() const;
   Handover* GetHandoverRegion(int idx);
 
+  // Box around all zones grown by margin on every side, relative to the
+  // frame like the zones and clipped to it; empty without any zone
+  Box ZoneBounds(float margin) const;
+
  private:
   std::vector<ParkingLot*> parking_lots;
   std::vector<Handover*> handovers;
+
+  ZoneIndex lot_index_;
+  ZoneIndex handover_index_;
+};
+
+// Handover regions of all cameras linked by the <link> ids of the XML files.
+// Every frame, exits queued in a region are matched with entries queued in
+// the regions linked to it, closest in time first, as long as they happened
+// within the time window of both regions. The entering track inherits the
+// label of the exiting one.
+class HandoverGraph
+{
+ public:
+  // Regions without an <id> are named "camera:region"; without any link in
+  // the files, two cameras fall back to the former fixed pair, region 1 of
+  // camera 0 with region 0 of camera 1
+  void Build(std::vector<GeoInfo>& geo_infos, double fps,
+      double default_window = 10.0);
+
+  void Match();
+
+  int NumLinks() const { return (int)links_.size(); }
+
+ private:
+  std::vector<Handover*> regions_;
+  std::vector<std::pair<int, int>> links_;
+  std::vector<int64_t> windows_;  // frames
 };
 }  // namespace yc
\ No newline at end of file
@@ -0,0 +1,541 @@
+#include <float.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "activations.h"
+#include "blas.h"
+#include "gemm.h"
+#include "im2col.h"
+#include "network.h"
+
+// Forward pass of a single image that recomputes only what depends on the
+// parts of the input changed since the previous call. Changed areas are kept
+// per layer as rectangles in its output coordinates, grown by the receptive
+// field of every CONVOLUTIONAL and MAXPOOL layer and scaled by UPSAMPLE ones.
+// Those layers, ROUTE and SHORTCUT recompute only their rectangles and keep
+// the outputs of the previous frame elsewhere. Other spatially local layers
+// run in full, which leaves their unchanged areas as they were; any other
+// layer marks its whole output as changed.
+namespace
+{
+int const kTileSize = 16;  // input pixels per side of a change detection tile
+int const kMaxRects = 16;  // beyond that the rectangles collapse to their bbox
+
+typedef struct DirtyRect
+{
+  int x0, y0, x1, y1;  // half-open
+
+  int Area() const { return (x1 - x0) * (y1 - y0); }
+} DirtyRect;
+
+typedef std::vector<DirtyRect> DirtyRegion;
+
+int DivFloor(int a, int b) { return a >= 0 ? a / b : -((-a + b - 1) / b); }
+int DivCeil(int a, int b) { return -DivFloor(-a, b); }
+
+bool Touch(DirtyRect const& a, DirtyRect const& b)
+{
+  return a.x0 <= b.x1 && b.x0 <= a.x1 && a.y0 <= b.y1 && b.y0 <= a.y1;
+}
+
+int RegionArea(DirtyRegion const& region)
+{
+  int area = 0;
+  for (size_t i = 0; i < region.size(); ++i)
+  {
+    area += region[i].Area();
+  }
+  return area;
+}
+
+// Merges touching rectangles into their bounding boxes until none touch, so
+// that no output element is computed twice
+void Normalize(DirtyRegion& region)
+{
+  bool merged = true;
+  while (merged)
+  {
+    merged = false;
+    for (size_t i = 0; i < region.size() && !merged; ++i)
+    {
+      for (size_t j = i + 1; j < region.size(); ++j)
+      {
+        if (!Touch(region[i], region[j]))
+          continue;
+
+        DirtyRect& a = region[i];
+        DirtyRect const& b = region[j];
+        a.x0 = std::min(a.x0, b.x0);
+        a.y0 = std::min(a.y0, b.y0);
+        a.x1 = std::max(a.x1, b.x1);
+        a.y1 = std::max(a.y1, b.y1);
+        region.erase(region.begin() + j);
+        merged = true;
+        break;
+      }
+    }
+  }
+
+  if ((int)region.size() > kMaxRects)
+  {
+    DirtyRect box = region.front();
+    for (size_t i = 1; i < region.size(); ++i)
+    {
+      box.x0 = std::min(box.x0, region[i].x0);
+      box.y0 = std::min(box.y0, region[i].y0);
+      box.x1 = std::max(box.x1, region[i].x1);
+      box.y1 = std::max(box.y1, region[i].y1);
+    }
+    region.assign(1, box);
+  }
+}
+
+DirtyRegion FullRegion(int w, int h)
+{
+  DirtyRect r = {0, 0, w, h};
+  return DirtyRegion(1, r);
+}
+
+// Tiles of the input with any value changed, as rectangles
+DirtyRegion InputRegion(float const* prev, float const* curr, int w, int h,
+    int c)
+{
+  int tiles_w = (w + kTileSize - 1) / kTileSize;
+  int tiles_h = (h + kTileSize - 1) / kTileSize;
+  std::vector<char> dirty(tiles_w * tiles_h, 0);
+
+#pragma omp parallel for
+  for (int y = 0; y < h; ++y)
+  {
+    for (int k = 0; k < c; ++k)
+    {
+      float const* p = prev + ((size_t)k * h + y) * w;
+      float const* q = curr + ((size_t)k * h + y) * w;
+      for (int x = 0; x < w; ++x)
+      {
+        if (p[x] != q[x])
+          dirty[(y / kTileSize) * tiles_w + x / kTileSize] = 1;
+      }
+    }
+  }
+
+  // runs of dirty tiles along every tile row, merged afterwards
+  DirtyRegion region;
+  for (int ty = 0; ty < tiles_h; ++ty)
+  {
+    for (int tx = 0; tx < tiles_w; ++tx)
+    {
+      if (!dirty[ty * tiles_w + tx])
+        continue;
+
+      int end = tx;
+      while (end < tiles_w && dirty[ty * tiles_w + end])
+      {
+        ++end;
+      }
+
+      DirtyRect r = {tx * kTileSize, ty * kTileSize,
+          std::min(end * kTileSize, w), std::min((ty + 1) * kTileSize, h)};
+      region.push_back(r);
+      tx = end;
+    }
+  }
+  Normalize(region);
+  return region;
+}
+
+// Outputs o reading inputs [o * stride - offset, o * stride - offset + span)
+DirtyRegion MapWindow(DirtyRegion const& in, int stride_x, int stride_y,
+    int offset, int span, int out_w, int out_h)
+{
+  DirtyRegion out;
+  for (size_t i = 0; i < in.size(); ++i)
+  {
+    DirtyRect const& r = in[i];
+    DirtyRect o;
+    o.x0 = std::max(DivCeil(r.x0 + offset - span + 1, stride_x), 0);
+    o.y0 = std::max(DivCeil(r.y0 + offset - span + 1, stride_y), 0);
+    o.x1 = std::min(DivFloor(r.x1 - 1 + offset, stride_x) + 1, out_w);
+    o.y1 = std::min(DivFloor(r.y1 - 1 + offset, stride_y) + 1, out_h);
+    if (o.x0 < o.x1 && o.y0 < o.y1)
+      out.push_back(o);
+  }
+  Normalize(out);
+  return out;
+}
+
+bool IsPlainActivation(ACTIVATION a)
+{
+  return a != NORM_CHAN && a != NORM_CHAN_SOFTMAX &&
+         a != NORM_CHAN_SOFTMAX_MAXVAL;
+}
+
+void Activate(float* x, int n, ACTIVATION a)
+{
+  if (a == SWISH)
+  {
+    std::vector<float> sigmoid(n);
+    activate_array_swish(x, n, &sigmoid[0], x);
+  }
+  else if (a == MISH)
+  {
+    std::vector<float> input(n);
+    activate_array_mish(x, n, &input[0], x);
+  }
+  else
+  {
+    activate_array_cpu_custom(x, n, a);
+  }
+}
+
+bool CanConvRect(layer const* l)
+{
+  return l->batch == 1 && !l->batch_normalize && !l->xnor && !l->binary &&
+         !l->antialiasing && l->dilation == 1 &&
+         (l->size != 1 || (l->stride_x == 1 && l->stride_y == 1)) &&
+         IsPlainActivation(l->activation);
+}
+
+// Same arithmetic as ForwardConvolutionalLayer on the outputs of r: the input
+// window of r, zero padded like im2col, goes through im2col and gemm
+void ConvRect(layer* l, float const* input, float* workspace,
+    DirtyRect const& r)
+{
+  int rw = r.x1 - r.x0;
+  int rh = r.y1 - r.y0;
+  int pw = (rw - 1) * l->stride_x + l->size;
+  int ph = (rh - 1) * l->stride_y + l->size;
+  int ix0 = r.x0 * l->stride_x - l->pad;
+  int iy0 = r.y0 * l->stride_y - l->pad;
+
+  int cg = l->c / l->groups;
+  int m = l->n / l->groups;
+  int k = l->size * l->size * cg;
+  int n = rw * rh;
+  int out_size = l->out_w * l->out_h;
+
+  std::vector<float> patch((size_t)cg * ph * pw);
+  std::vector<float> out((size_t)m * n);
+  for (int g = 0; g < l->groups; ++g)
+  {
+#pragma omp parallel for
+    for (int ch = 0; ch < cg; ++ch)
+    {
+      float const* src = input + (size_t)(g * cg + ch) * l->h * l->w;
+      for (int py = 0; py < ph; ++py)
+      {
+        float* dst = &patch[((size_t)ch * ph + py) * pw];
+        int iy = iy0 + py;
+        int x_lo = std::max(-ix0, 0);
+        int x_hi = std::min(l->w - ix0, pw);
+        if (iy < 0 || iy >= l->h || x_lo >= x_hi)
+        {
+          std::fill(dst, dst + pw, 0.0f);
+          continue;
+        }
+
+        std::fill(dst, dst + x_lo, 0.0f);
+        memcpy(dst + x_lo, src + (size_t)iy * l->w + ix0 + x_lo,
+            (x_hi - x_lo) * sizeof(float));
+        std::fill(dst + x_hi, dst + pw, 0.0f);
+      }
+    }
+
+    float* b = &patch[0];
+    if (l->size != 1 || l->stride_x != 1 || l->stride_y != 1)
+    {
+      b = workspace;
+      im2col_cpu_ext(&patch[0], cg, ph, pw, l->size, l->size, 0, 0,
+          l->stride_y, l->stride_x, 1, 1, b);
+    }
+
+    float* a = l->weights + g * l->nweights / l->groups;
+    std::fill(out.begin(), out.end(), 0.0f);
+    gemm(0, 0, m, n, k, 1, a, k, b, n, 1, &out[0], n);
+
+    for (int o = 0; o < m; ++o)
+    {
+      float bias = l->biases[g * m + o];
+      float* row = &out[(size_t)o * n];
+      for (int i = 0; i < n; ++i)
+      {
+        row[i] += bias;
+      }
+    }
+    Activate(&out[0], m * n, l->activation);
+
+    for (int o = 0; o < m; ++o)
+    {
+      float* dst = l->output + (size_t)(g * m + o) * out_size;
+      for (int y = 0; y < rh; ++y)
+      {
+        memcpy(dst + (size_t)(r.y0 + y) * l->out_w + r.x0,
+            &out[(size_t)o * n + y * rw], rw * sizeof(float));
+      }
+    }
+  }
+}
+
+void MaxpoolRect(layer* l, float const* input, DirtyRect const& r)
+{
+  int offset = -l->pad / 2;
+#pragma omp parallel for
+  for (int k = 0; k < l->c; ++k)
+  {
+    float const* src = input + (size_t)k * l->h * l->w;
+    float* dst = l->output + (size_t)k * l->out_h * l->out_w;
+    for (int i = r.y0; i < r.y1; ++i)
+    {
+      for (int j = r.x0; j < r.x1; ++j)
+      {
+        float max = -FLT_MAX;
+        for (int n = 0; n < l->size; ++n)
+        {
+          int cur_h = offset + i * l->stride_y + n;
+          if (cur_h < 0 || cur_h >= l->h)
+            continue;
+
+          for (int m = 0; m < l->size; ++m)
+          {
+            int cur_w = offset + j * l->stride_x + m;
+            if (cur_w >= 0 && cur_w < l->w)
+              max = std::max(max, src[cur_h * l->w + cur_w]);
+          }
+        }
+        dst[i * l->out_w + j] = max;
+      }
+    }
+  }
+}
+
+void UpsampleRect(layer* l, float const* input, DirtyRect const& r)
+{
+  int s = l->stride;
+  for (int k = 0; k < l->c; ++k)
+  {
+    float const* src = input + (size_t)k * l->h * l->w;
+    float* dst = l->output + (size_t)k * l->out_h * l->out_w;
+    for (int y = r.y0; y < r.y1; ++y)
+    {
+      for (int x = r.x0; x < r.x1; ++x)
+      {
+        dst[y * l->out_w + x] = l->scale * src[(y / s) * l->w + x / s];
+      }
+    }
+  }
+}
+
+bool CanRouteRect(Network* net, layer const* l)
+{
+  for (int i = 0; i < l->n; ++i)
+  {
+    layer const* in = &net->layers[l->input_layers[i]];
+    if (in->out_w != l->out_w || in->out_h != l->out_h)
+      return false;
+  }
+  return l->batch == 1;
+}
+
+void RouteRect(Network* net, layer* l, DirtyRect const& r)
+{
+  int size = l->out_w * l->out_h;
+  int offset = 0;
+  for (int i = 0; i < l->n; ++i)
+  {
+    float const* input = net->layers[l->input_layers[i]].output;
+    int part_c = l->input_sizes[i] / l->groups / size;
+    float const* src = input + (size_t)part_c * l->group_id * size;
+    for (int k = 0; k < part_c; ++k)
+    {
+      for (int y = r.y0; y < r.y1; ++y)
+      {
+        size_t idx = (size_t)y * l->out_w + r.x0;
+        memcpy(l->output + (size_t)(offset + k) * size + idx,
+            src + (size_t)k * size + idx, (r.x1 - r.x0) * sizeof(float));
+      }
+    }
+    offset += part_c;
+  }
+}
+
+bool CanShortcutRect(Network* net, layer const* l)
+{
+  layer const* from = &net->layers[l->index];
+  return l->batch == 1 && l->nweights == 0 && l->n == 1 &&
+         from->out_w == l->w && from->out_h == l->h && from->out_c == l->c &&
+         IsPlainActivation(l->activation);
+}
+
+void ShortcutRect(
+    Network* net, layer* l, float const* input, DirtyRect const& r)
+{
+  float const* from = net->layers[l->index].output;
+  int size = l->out_w * l->out_h;
+  int rw = r.x1 - r.x0;
+  for (int k = 0; k < l->out_c; ++k)
+  {
+    for (int y = r.y0; y < r.y1; ++y)
+    {
+      size_t idx = (size_t)k * size + (size_t)y * l->out_w + r.x0;
+      for (int x = 0; x < rw; ++x)
+      {
+        l->output[idx + x] = input[idx + x] + from[idx + x];
+      }
+      Activate(l->output + idx, rw, l->activation);
+    }
+  }
+}
+
+// Layers computing each output from the input at the same position only, so
+// that their changed area is the one of their input; pooling layers spread
+// changes over their window and are not among them
+bool IsLocalLayer(LAYER_TYPE type)
+{
+  return type == YOLO || type == GAUSSIAN_YOLO || type == ACTIVE ||
+         type == BATCHNORM;
+}
+
+void FullForward(Network* net, float* input)
+{
+  NetworkState state = {0};
+  state.net = net;
+  state.input = input;
+  ForwardNetwork(net, state);
+}
+}  // namespace
+
+float* NetworkPredictIncremental(Network* net, float* input, float max_dirty)
+{
+#ifdef GPU
+  if (cuda_get_device() >= 0)
+  {
+    net->inc_valid = 0;
+    net->inc_dirty = 1.0f;
+    return NetworkPredict(net, input);
+  }
+#endif
+
+  SelectNetworkBatch(net, 0);
+
+  int input_size = net->w * net->h * net->c;
+  if (net->inc_input == nullptr)
+    net->inc_input = (float*)xcalloc(input_size, sizeof(float));
+
+  DirtyRegion region;
+  if (net->inc_valid && net->batch == 1)
+    region = InputRegion(net->inc_input, input, net->w, net->h, net->c);
+
+  float dirty = (float)RegionArea(region) / (net->w * net->h);
+  if (!net->inc_valid || net->batch != 1 || dirty > max_dirty)
+  {
+    FullForward(net, input);
+    memcpy(net->inc_input, input, input_size * sizeof(float));
+    net->inc_valid = 1;
+    net->inc_dirty = 1.0f;
+    return GetNetworkOutput(net);
+  }
+
+  net->inc_dirty = dirty;
+  if (region.empty())
+    return GetNetworkOutput(net);
+
+  std::vector<DirtyRegion> regions(net->n);
+  float const* layer_input = input;
+  for (int i = 0; i < net->n; ++i)
+  {
+    if (net->skip_layers && net->skip_layers[i])
+      continue;
+
+    layer* l = &net->layers[i];
+    DirtyRegion& out = regions[i];
+    bool partial = false;
+
+    if (l->type == CONVOLUTIONAL && CanConvRect(l))
+    {
+      out = MapWindow(region, l->stride_x, l->stride_y, l->pad, l->size,
+          l->out_w, l->out_h);
+      partial = true;
+    }
+    else if (l->type == MAXPOOL && !l->maxpool_depth && !l->antialiasing)
+    {
+      out = MapWindow(region, l->stride_x, l->stride_y, l->pad / 2, l->size,
+          l->out_w, l->out_h);
+      // the vectorized stride 1 kernel skips the left border taps of whole
+      // 8-column blocks, which MaxpoolRect would not reproduce
+      partial = l->stride_x > 1 || l->stride_y > 1;
+    }
+    else if (l->type == UPSAMPLE && !l->reverse)
+    {
+      for (size_t j = 0; j < region.size(); ++j)
+      {
+        DirtyRect r = {region[j].x0 * l->stride, region[j].y0 * l->stride,
+            region[j].x1 * l->stride, region[j].y1 * l->stride};
+        out.push_back(r);
+      }
+      partial = true;
+    }
+    else if (l->type == ROUTE && CanRouteRect(net, l))
+    {
+      for (int j = 0; j < l->n; ++j)
+      {
+        DirtyRegion const& in = regions[l->input_layers[j]];
+        out.insert(out.end(), in.begin(), in.end());
+      }
+      Normalize(out);
+      partial = true;
+    }
+    else if (l->type == SHORTCUT && CanShortcutRect(net, l))
+    {
+      out = region;
+      DirtyRegion const& from = regions[l->index];
+      out.insert(out.end(), from.begin(), from.end());
+      Normalize(out);
+      partial = true;
+    }
+    else if (IsLocalLayer(l->type) && l->out_w == l->w && l->out_h == l->h)
+    {
+      out = region;
+    }
+    else if (!region.empty() || l->type == ROUTE || l->type == SHORTCUT)
+    {
+      out = FullRegion(l->out_w, l->out_h);
+    }
+
+    // an empty region keeps the output of the previous frame; recomputing
+    // most of a layer is cheaper in one piece
+    float area = (float)RegionArea(out) / (l->out_w * l->out_h);
+    if (!out.empty() && (!partial || area > max_dirty))
+    {
+      NetworkState state = {0};
+      state.net = net;
+      state.input = (float*)layer_input;
+      state.workspace = net->workspace;
+      state.index = i;
+      l->forward(l, state);
+    }
+    else
+    {
+      for (size_t j = 0; j < out.size(); ++j)
+      {
+        if (l->type == CONVOLUTIONAL)
+          ConvRect(l, layer_input, net->workspace, out[j]);
+        else if (l->type == MAXPOOL)
+          MaxpoolRect(l, layer_input, out[j]);
+        else if (l->type == UPSAMPLE)
+          UpsampleRect(l, layer_input, out[j]);
+        else if (l->type == ROUTE)
+          RouteRect(net, l, out[j]);
+        else if (l->type == SHORTCUT)
+          ShortcutRect(net, l, layer_input, out[j]);
+      }
+    }
+
+    region = out;
+    layer_input = l->output;
+  }
+
+  memcpy(net->inc_input, input, input_size * sizeof(float));
+  return GetNetworkOutput(net);
+}
@@ -0,0 +1,196 @@
+#include "kalman_store.h"
+
+#include <stddef.h>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace yc
+{
+KalmanStore::KalmanStore(float process_noise, float measurement_noise)
+    : q_(process_noise), r_(measurement_noise)
+{
+}
+
+void KalmanStore::Clear()
+{
+  x.clear();
+  y.clear();
+  vx.clear();
+  vy.clear();
+  p00.clear();
+  p01.clear();
+  p11.clear();
+}
+
+int KalmanStore::Add(float px, float py)
+{
+  x.push_back(px);
+  y.push_back(py);
+  vx.push_back(0.0f);
+  vy.push_back(0.0f);
+  p00.push_back(0.0f);
+  p01.push_back(0.0f);
+  p11.push_back(0.0f);
+
+  return Size() - 1;
+}
+
+int KalmanStore::Add(KalmanStore const& src, int slot)
+{
+  x.push_back(src.x[slot]);
+  y.push_back(src.y[slot]);
+  vx.push_back(src.vx[slot]);
+  vy.push_back(src.vy[slot]);
+  p00.push_back(src.p00[slot]);
+  p01.push_back(src.p01[slot]);
+  p11.push_back(src.p11[slot]);
+
+  return Size() - 1;
+}
+
+void KalmanStore::Compact(std::vector<int> const& keep)
+{
+  std::vector<float>* cols[] = {&x, &y, &vx, &vy, &p00, &p01, &p11};
+  for (size_t c = 0; c < sizeof(cols) / sizeof(cols[0]); c++)
+  {
+    std::vector<float> kept(keep.size());
+    for (size_t i = 0; i < keep.size(); i++)
+    {
+      kept[i] = (*cols[c])[keep[i]];
+    }
+    cols[c]->swap(kept);
+  }
+}
+
+// x' = F x, P' = F P F^T + Q with F = [1 1; 0 1] per axis
+void KalmanStore::Predict(int i)
+{
+  x[i] += vx[i];
+  y[i] += vy[i];
+
+  float a = p00[i], b = p01[i], d = p11[i];
+  p00[i] = a + b + b + d + q_;
+  p01[i] = b + d;
+  p11[i] = d + q_;
+}
+
+// K = P H^T / (H P H^T + r), x += K (z - H x), P -= K H P with H = [1 0]
+void KalmanStore::Correct(int i, float zx, float zy)
+{
+  float s = p00[i] + r_;
+  float k0 = p00[i] / s;
+  float k1 = p01[i] / s;
+
+  float ex = zx - x[i];
+  float ey = zy - y[i];
+  x[i] += k0 * ex;
+  y[i] += k0 * ey;
+  vx[i] += k1 * ex;
+  vy[i] += k1 * ey;
+
+  float a = p00[i], b = p01[i];
+  p00[i] = a - k0 * a;
+  p01[i] = b - k0 * b;
+  p11[i] = p11[i] - k1 * b;
+}
+
+#ifdef __AVX2__
+namespace
+{
+// lanes whose mask byte is set
+__m256 LoadMask8(char const* mask)
+{
+  __m128i bytes = _mm_loadl_epi64((__m128i const*)mask);
+  __m256i lanes = _mm256_cvtepi8_epi32(bytes);
+  return _mm256_castsi256_ps(
+      _mm256_cmpgt_epi32(_mm256_abs_epi32(lanes), _mm256_setzero_si256()));
+}
+
+void Store8(float* dst, __m256 val, __m256 mask)
+{
+  _mm256_storeu_ps(dst, _mm256_blendv_ps(_mm256_loadu_ps(dst), val, mask));
+}
+}  // namespace
+#endif
+
+void KalmanStore::Predict(char const* mask)
+{
+  int const n = Size();
+  int i = 0;
+#ifdef __AVX2__
+  __m256 const q = _mm256_set1_ps(q_);
+  for (; i + 8 <= n; i += 8)
+  {
+    __m256 m = LoadMask8(&mask[i]);
+    if (_mm256_testz_ps(m, m))
+      continue;
+
+    __m256 a = _mm256_loadu_ps(&p00[i]);
+    __m256 b = _mm256_loadu_ps(&p01[i]);
+    __m256 d = _mm256_loadu_ps(&p11[i]);
+    __m256 vxi = _mm256_loadu_ps(&vx[i]);
+    __m256 vyi = _mm256_loadu_ps(&vy[i]);
+
+    Store8(&x[i], _mm256_add_ps(_mm256_loadu_ps(&x[i]), vxi), m);
+    Store8(&y[i], _mm256_add_ps(_mm256_loadu_ps(&y[i]), vyi), m);
+
+    __m256 na = _mm256_add_ps(
+        _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(a, b), b), d), q);
+    Store8(&p00[i], na, m);
+    Store8(&p01[i], _mm256_add_ps(b, d), m);
+    Store8(&p11[i], _mm256_add_ps(d, q), m);
+  }
+#endif
+  for (; i < n; i++)
+  {
+    if (mask[i])
+      Predict(i);
+  }
+}
+
+void KalmanStore::Correct(char const* mask, float const* zx, float const* zy)
+{
+  int const n = Size();
+  int i = 0;
+#ifdef __AVX2__
+  __m256 const r = _mm256_set1_ps(r_);
+  for (; i + 8 <= n; i += 8)
+  {
+    __m256 m = LoadMask8(&mask[i]);
+    if (_mm256_testz_ps(m, m))
+      continue;
+
+    __m256 a = _mm256_loadu_ps(&p00[i]);
+    __m256 b = _mm256_loadu_ps(&p01[i]);
+    __m256 d = _mm256_loadu_ps(&p11[i]);
+
+    __m256 s = _mm256_add_ps(a, r);
+    __m256 k0 = _mm256_div_ps(a, s);
+    __m256 k1 = _mm256_div_ps(b, s);
+
+    __m256 xi = _mm256_loadu_ps(&x[i]);
+    __m256 yi = _mm256_loadu_ps(&y[i]);
+    __m256 ex = _mm256_sub_ps(_mm256_loadu_ps(&zx[i]), xi);
+    __m256 ey = _mm256_sub_ps(_mm256_loadu_ps(&zy[i]), yi);
+
+    Store8(&x[i], _mm256_add_ps(xi, _mm256_mul_ps(k0, ex)), m);
+    Store8(&y[i], _mm256_add_ps(yi, _mm256_mul_ps(k0, ey)), m);
+    Store8(&vx[i],
+        _mm256_add_ps(_mm256_loadu_ps(&vx[i]), _mm256_mul_ps(k1, ex)), m);
+    Store8(&vy[i],
+        _mm256_add_ps(_mm256_loadu_ps(&vy[i]), _mm256_mul_ps(k1, ey)), m);
+
+    Store8(&p00[i], _mm256_sub_ps(a, _mm256_mul_ps(k0, a)), m);
+    Store8(&p01[i], _mm256_sub_ps(b, _mm256_mul_ps(k0, b)), m);
+    Store8(&p11[i], _mm256_sub_ps(d, _mm256_mul_ps(k1, b)), m);
+  }
+#endif
+  for (; i < n; i++)
+  {
+    if (mask[i])
+      Correct(i, zx[i], zy[i]);
+  }
+}
+}  // namespace yc
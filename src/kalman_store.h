@@ -0,0 +1,41 @@
+#pragma once
+#include <vector>
+
+namespace yc
+{
+// Constant velocity Kalman filters of many tracks in structure-of-arrays
+// layout. The x and y axes follow identical one-dimensional models with
+// isotropic noise, so each track keeps a single 2x2 position-velocity
+// covariance (p00, p01, p11) shared by both axes. Predict() writes the prior
+// back as the posterior, like cv::KalmanFilter::predict().
+class KalmanStore
+{
+ public:
+  KalmanStore(float process_noise = 1e-4f, float measurement_noise = 2e-4f);
+
+  void Clear();
+  int Size() const { return (int)x.size(); }
+
+  // Appends a filter at rest with zero covariance and returns its slot
+  int Add(float px, float py);
+  int Add(KalmanStore const& src, int slot);
+
+  // Keeps the slots listed in keep, moving keep[i] to slot i
+  void Compact(std::vector<int> const& keep);
+
+  // Batched over every slot whose mask is set
+  void Predict(char const* mask);
+  void Correct(char const* mask, float const* zx, float const* zy);
+
+  void Predict(int slot);
+  void Correct(int slot, float zx, float zy);
+
+ public:
+  std::vector<float> x, y, vx, vy;
+  std::vector<float> p00, p01, p11;
+
+ private:
+  float q_;
+  float r_;
+};
+}  // namespace yc
@@ -0,0 +1,347 @@
+#include "lapjv.h"
+
+#include <float.h>
+
+#include <algorithm>
+
+// R. Jonker and A. Volgenant, "A shortest augmenting path algorithm for dense
+// and sparse linear assignment problems", Computing 38, 1987
+namespace
+{
+// Square problem with rectangular inputs padded by zero-cost dummies
+class Lapjv
+{
+ public:
+  Lapjv(float const* cost, int rows, int cols)
+      : n_(std::max(rows, cols)),
+        cost_((size_t)n_ * n_, 0.0),
+        x_(n_, -1),
+        y_(n_, -1),
+        v_(n_, 0.0)
+  {
+    for (int i = 0; i < rows; ++i)
+    {
+      for (int j = 0; j < cols; ++j)
+      {
+        cost_[(size_t)i * n_ + j] = cost[(size_t)i * cols + j];
+      }
+    }
+  }
+
+  std::vector<int> const& Solve()
+  {
+    std::vector<int> free_rows;
+    ColumnReduction(free_rows);
+    for (int pass = 0; pass < 2 && !free_rows.empty(); ++pass)
+    {
+      AugmentingRowReduction(free_rows);
+    }
+    Augmentation(free_rows);
+    return x_;
+  }
+
+ private:
+  double Cost(int i, int j) const { return cost_[(size_t)i * n_ + j]; }
+
+  // Assigns each column to its cheapest row, keeping the first claim of a row
+  void ColumnReduction(std::vector<int>& free_rows)
+  {
+    for (int j = 0; j < n_; ++j)
+    {
+      v_[j] = DBL_MAX;
+      for (int i = 0; i < n_; ++i)
+      {
+        if (Cost(i, j) < v_[j])
+        {
+          v_[j] = Cost(i, j);
+          y_[j] = i;
+        }
+      }
+    }
+
+    std::vector<char> unique(n_, 1);
+    for (int j = n_ - 1; j >= 0; --j)
+    {
+      int i = y_[j];
+      if (x_[i] < 0)
+      {
+        x_[i] = j;
+      }
+      else
+      {
+        unique[i] = 0;
+        y_[j] = -1;
+      }
+    }
+
+    // reduction transfer from assigned rows
+    for (int i = 0; i < n_; ++i)
+    {
+      if (x_[i] < 0)
+      {
+        free_rows.push_back(i);
+      }
+      else if (unique[i])
+      {
+        int j = x_[i];
+        double min_val = DBL_MAX;
+        for (int k = 0; k < n_; ++k)
+        {
+          if (k != j)
+            min_val = std::min(min_val, Cost(i, k) - v_[k]);
+        }
+        if (min_val != DBL_MAX)
+          v_[j] -= min_val;
+      }
+    }
+  }
+
+  void AugmentingRowReduction(std::vector<int>& free_rows)
+  {
+    int num_free = (int)free_rows.size();
+    int current = 0;
+    int new_free = 0;
+    long long iter = 0;
+    while (current < num_free)
+    {
+      iter++;
+      int i = free_rows[current++];
+
+      // smallest and second smallest reduced costs of row i
+      int j1 = 0;
+      int j2 = -1;
+      double u1 = Cost(i, 0) - v_[0];
+      double u2 = DBL_MAX;
+      for (int j = 1; j < n_; ++j)
+      {
+        double h = Cost(i, j) - v_[j];
+        if (h < u2)
+        {
+          if (h >= u1)
+          {
+            u2 = h;
+            j2 = j;
+          }
+          else
+          {
+            u2 = u1;
+            u1 = h;
+            j2 = j1;
+            j1 = j;
+          }
+        }
+      }
+
+      int i0 = y_[j1];
+      double v1_new = v_[j1] - (u2 - u1);
+      bool v1_lowers = v1_new < v_[j1];
+      if (iter < (long long)current * n_)
+      {
+        if (v1_lowers)
+        {
+          v_[j1] = v1_new;
+        }
+        else if (i0 >= 0 && j2 >= 0)
+        {
+          j1 = j2;
+          i0 = y_[j2];
+        }
+
+        if (i0 >= 0)
+        {
+          if (v1_lowers)
+            free_rows[--current] = i0;
+          else
+            free_rows[new_free++] = i0;
+        }
+      }
+      else if (i0 >= 0)
+      {
+        free_rows[new_free++] = i0;
+      }
+
+      x_[i] = j1;
+      y_[j1] = i;
+    }
+    free_rows.resize(new_free);
+  }
+
+  // Dijkstra-like shortest augmenting path from each remaining free row
+  void Augmentation(std::vector<int> const& free_rows)
+  {
+    std::vector<int> cols(n_);
+    std::vector<int> pred(n_);
+    std::vector<double> d(n_);
+    for (size_t f = 0; f < free_rows.size(); ++f)
+    {
+      int start = free_rows[f];
+      int j = FindPath(start, cols, pred, d);
+
+      int i = -1;
+      while (i != start)
+      {
+        i = pred[j];
+        y_[j] = i;
+        std::swap(j, x_[i]);
+      }
+    }
+  }
+
+  int FindPath(int start, std::vector<int>& cols, std::vector<int>& pred,
+      std::vector<double>& d)
+  {
+    for (int j = 0; j < n_; ++j)
+    {
+      cols[j] = j;
+      pred[j] = start;
+      d[j] = Cost(start, j) - v_[j];
+    }
+
+    // cols[0, ready) are done, cols[lo, hi) hold the current minimum
+    int lo = 0;
+    int hi = 0;
+    int ready = 0;
+    int final_j = -1;
+    while (final_j < 0)
+    {
+      if (lo == hi)
+      {
+        ready = lo;
+        hi = FindMinimum(lo, cols, d);
+        for (int k = lo; k < hi; ++k)
+        {
+          if (y_[cols[k]] < 0)
+          {
+            final_j = cols[k];
+            break;
+          }
+        }
+      }
+
+      if (final_j < 0)
+        final_j = Scan(lo, hi, cols, pred, d);
+    }
+
+    double min_d = d[cols[lo]];
+    for (int k = 0; k < ready; ++k)
+    {
+      int j = cols[k];
+      v_[j] += d[j] - min_d;
+    }
+
+    return final_j;
+  }
+
+  // Moves the columns with minimal d from cols[lo, n) to cols[lo, hi)
+  int FindMinimum(int lo, std::vector<int>& cols, std::vector<double> const& d)
+  {
+    int hi = lo + 1;
+    double min_d = d[cols[lo]];
+    for (int k = hi; k < n_; ++k)
+    {
+      int j = cols[k];
+      if (d[j] <= min_d)
+      {
+        if (d[j] < min_d)
+        {
+          hi = lo;
+          min_d = d[j];
+        }
+        cols[k] = cols[hi];
+        cols[hi++] = j;
+      }
+    }
+    return hi;
+  }
+
+  // Relaxes the paths through the rows matched to cols[lo, hi); returns a
+  // free column reached at the current minimum distance, or -1 after
+  // advancing lo and hi; lo is left untouched on success as it marks min d
+  int Scan(int& plo, int& phi, std::vector<int>& cols, std::vector<int>& pred,
+      std::vector<double>& d)
+  {
+    int lo = plo;
+    int hi = phi;
+    while (lo != hi)
+    {
+      int j = cols[lo++];
+      int i = y_[j];
+      double min_d = d[j];
+      double h = Cost(i, j) - v_[j] - min_d;
+      for (int k = hi; k < n_; ++k)
+      {
+        j = cols[k];
+        double reduced = Cost(i, j) - v_[j] - h;
+        if (reduced < d[j])
+        {
+          d[j] = reduced;
+          pred[j] = i;
+          if (reduced == min_d)
+          {
+            if (y_[j] < 0)
+              return j;
+            cols[k] = cols[hi];
+            cols[hi++] = j;
+          }
+        }
+      }
+    }
+
+    plo = lo;
+    phi = hi;
+    return -1;
+  }
+
+ private:
+  int n_;
+  std::vector<double> cost_;
+  std::vector<int> x_;  // column of each row
+  std::vector<int> y_;  // row of each column
+  std::vector<double> v_;
+};
+
+// Rows whose cheapest columns are all distinct are optimally assigned to them
+bool SolveTrivial(
+    float const* cost, int rows, int cols, std::vector<int>& assignment)
+{
+  if (rows > cols)
+    return false;
+
+  std::vector<char> taken(cols, 0);
+  assignment.assign(rows, -1);
+  for (int i = 0; i < rows; ++i)
+  {
+    float const* row = cost + (size_t)i * cols;
+    int best = (int)(std::min_element(row, row + cols) - row);
+    if (taken[best])
+      return false;
+
+    taken[best] = 1;
+    assignment[i] = best;
+  }
+  return true;
+}
+}  // namespace
+
+std::vector<int> SolveAssignment(float const* cost, int rows, int cols)
+{
+  std::vector<int> assignment;
+  if (rows == 0 || cols == 0)
+  {
+    assignment.assign(rows, -1);
+    return assignment;
+  }
+
+  if (SolveTrivial(cost, rows, cols, assignment))
+    return assignment;
+
+  Lapjv lap(cost, rows, cols);
+  std::vector<int> const& x = lap.Solve();
+
+  assignment.resize(rows);
+  for (int i = 0; i < rows; ++i)
+  {
+    assignment[i] = x[i] < cols ? x[i] : -1;
+  }
+  return assignment;
+}
@@ -0,0 +1,10 @@
+#pragma once
+#include <vector>
+
+#include "libapi.h"
+
+// Minimum-cost assignment of a dense rows x cols cost matrix stored row-major
+// in a flat array, solved by Jonker-Volgenant (LAPJV). Every row is assigned
+// when rows <= cols and every column otherwise. Returns the column assigned
+// to each row, or -1 for rows left unassigned.
+LIB_API std::vector<int> SolveAssignment(float const* cost, int rows, int cols);
@@ -0,0 +1,112 @@
+#include "motion_gate.h"
+
+#include <algorithm>
+
+namespace yc
+{
+MotionGate::MotionGate(float threshold, int max_skip, int width, int block)
+    : threshold_(threshold),
+      max_skip_(max_skip),
+      width_(std::max(width, block)),
+      block_(std::max(block, 1)),
+      skipped_in_row_(0),
+      num_frames_(0),
+      num_skipped_(0),
+      last_diff_(0.0f)
+{
+}
+
+void MotionGate::SetMask(cv::Mat const& mask)
+{
+  if (mask.empty() || mask.channels() == 1)
+    mask_ = mask;
+  else
+    cv::cvtColor(mask, mask_, cv::COLOR_BGR2GRAY);
+
+  block_mask_.release();
+}
+
+// Gray image whose sides are multiples of the block size, width_ wide
+void MotionGate::Shrink(cv::Mat const& frame, cv::Mat& gray) const
+{
+  int w = std::max(width_ / block_, 1) * block_;
+  int h = (int)((double)frame.rows * w / frame.cols + 0.5);
+  h = std::max(h / block_, 1) * block_;
+
+  cv::Mat small;
+  cv::resize(frame, small, cv::Size(w, h), 0, 0, cv::INTER_AREA);
+  if (small.channels() == 3)
+    cv::cvtColor(small, gray, cv::COLOR_BGR2GRAY);
+  else
+    gray = small;
+}
+
+void MotionGate::UpdateBlockMask(cv::Size grid)
+{
+  if (mask_.empty() || block_mask_.size() == grid)
+    return;
+
+  // a block is watched if any mask pixel inside it is set
+  cv::Mat mask, area;
+  mask_.convertTo(mask, CV_32F);
+  cv::resize(mask, area, grid, 0, 0, cv::INTER_AREA);
+  cv::threshold(area, area, 0, 255, cv::THRESH_BINARY);
+  area.convertTo(block_mask_, CV_8U);
+}
+
+bool MotionGate::Changed(cv::Mat const& frame)
+{
+  num_frames_++;
+
+  cv::Mat& gray = last_;
+  Shrink(frame, gray);
+
+  bool changed = ref_.empty() || ref_.size() != gray.size() ||
+                 (max_skip_ > 0 && skipped_in_row_ >= max_skip_);
+  last_diff_ = 0.0f;
+  if (!ref_.empty() && ref_.size() == gray.size())
+  {
+    cv::Mat diff, block_diff;
+    cv::absdiff(gray, ref_, diff);
+    diff.convertTo(diff, CV_32F);
+
+    // area averaging to one pixel per block gives the block means
+    cv::Size grid(gray.cols / block_, gray.rows / block_);
+    cv::resize(diff, block_diff, grid, 0, 0, cv::INTER_AREA);
+
+    UpdateBlockMask(grid);
+    double max_diff = 0.0;
+    if (mask_.empty())
+      cv::minMaxLoc(block_diff, nullptr, &max_diff);
+    else
+      cv::minMaxLoc(block_diff, nullptr, &max_diff, nullptr, nullptr,
+          block_mask_);
+
+    last_diff_ = (float)max_diff;
+    changed = changed || last_diff_ > threshold_;
+  }
+
+  if (changed)
+  {
+    skipped_in_row_ = 0;
+  }
+  else
+  {
+    skipped_in_row_++;
+    num_skipped_++;
+  }
+  return changed;
+}
+
+void MotionGate::SetReference() { last_.copyTo(ref_); }
+
+double MotionGate::SkipRate() const
+{
+  return num_frames_ > 0 ? (double)num_skipped_ / num_frames_ : 0.0;
+}
+
+double MotionGate::InferenceRate() const
+{
+  return num_frames_ > 0 ? 1.0 - SkipRate() : 0.0;
+}
+}  // namespace yc
@@ -0,0 +1,62 @@
+#pragma once
+#include <opencv2/opencv.hpp>
+
+#include "libapi.h"
+
+namespace yc
+{
+// Cheap change detector run ahead of the network on fixed cameras. Frames are
+// shrunk to a small gray image split in blocks, and a frame counts as changed
+// when the mean absolute difference of any watched block against the last
+// frame the detector ran on exceeds the threshold, in gray levels. Unchanged
+// frames can reuse the previous detections instead of a forward pass.
+class LIB_API MotionGate
+{
+ public:
+  // After max_skip unchanged frames in a row the next one is reported as
+  // changed anyway, so slow drifts are caught up; 0 never forces it
+  MotionGate(float threshold = 8.0f, int max_skip = 0, int width = 160,
+      int block = 8);
+
+  // Only the blocks covering a non-zero pixel of mask are watched, the mask
+  // being scaled to the frames; an empty mask watches the whole frame
+  void SetMask(cv::Mat const& mask);
+
+  // Counts a frame; true if it changed against the reference
+  bool Changed(cv::Mat const& frame);
+
+  // Makes the frame last passed to Changed() the reference, to be called
+  // when the detector ran on it; frames only propagated by the tracker keep
+  // the older reference so that they are not taken as detected
+  void SetReference();
+
+  long long NumFrames() const { return num_frames_; }
+  long long NumSkipped() const { return num_skipped_; }
+
+  // fractions of frames reported unchanged and changed
+  double SkipRate() const;
+  double InferenceRate() const;
+
+  // largest watched block difference of the last frame
+  float LastDiff() const { return last_diff_; }
+
+ private:
+  void Shrink(cv::Mat const& frame, cv::Mat& gray) const;
+  void UpdateBlockMask(cv::Size grid);
+
+  float threshold_;
+  int max_skip_;
+  int width_;
+  int block_;
+
+  cv::Mat mask_;
+  cv::Mat block_mask_;  // CV_8U, one pixel per block
+  cv::Mat ref_;         // shrunk gray reference frame
+  cv::Mat last_;        // shrunk gray frame of the last Changed() call
+
+  int skipped_in_row_;
+  long long num_frames_;
+  long long num_skipped_;
+  float last_diff_;
+};
+}  // namespace yc
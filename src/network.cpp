@@ -2,9 +2,12 @@
 
 #include <assert.h>
 #include <float.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <time.h>
 
+#include <vector>
+
 #include "activation_layer.h"
 #include "avgpool_layer.h"
 #include "batchnorm_layer.h"
@@ -108,6 +111,9 @@ void ForwardNetwork(Network* net, NetworkState state)
     if (l->delta && state.train)
       scal_cpu(l->outputs * l->batch, 0, l->delta, 1);
 
+    if (!state.train && net->skip_layers && net->skip_layers[i])
+      continue;
+
     l->forward(l, state);
     state.input = l->output;
   }
@@ -254,6 +260,11 @@ int GetNetworkOutputSize(Network* net)
 
 void ResizeNetwork(Network* net, int w, int h)
 {
+  SelectNetworkBatch(net, 0);
+  free(net->inc_input);
+  net->inc_input = nullptr;
+  net->inc_valid = 0;
+
 #ifdef GPU
   cuda_set_device(net->gpu_index);
   if (cuda_get_device() >= 0)
@@ -411,6 +422,9 @@ void ResizeNetwork(Network* net, int w, int h)
 
 float* NetworkPredict(Network* net, float* input)
 {
+  SelectNetworkBatch(net, 0);
+  net->inc_valid = 0;
+
 #ifdef GPU
   if (cuda_get_device() >= 0)
     return NetworkPredictGpu(net, input);
@@ -429,13 +443,123 @@ float* NetworkPredict(Network* net, float* input)
   return GetNetworkOutput(net);
 }
 
+static bool IsDetectionHead(layer const* l)
+{
+  return l->type == YOLO || l->type == GAUSSIAN_YOLO || l->type == DETECTION;
+}
+
+// The box decoders read the first image of every detection head. This shifts
+// the head outputs to image b of the last forward pass, so that the images of
+// a batch are decoded one after another by the same code; NetworkPredict(),
+// ResizeNetwork() and FreeNetwork() shift them back to the first image.
+void SelectNetworkBatch(Network* net, int b)
+{
+  int shift = b - net->batch_index;
+  if (shift == 0)
+    return;
+
+  for (int i = 0; i < net->n; ++i)
+  {
+    layer* l = &net->layers[i];
+    if (IsDetectionHead(l))
+      l->output += (ptrdiff_t)shift * l->outputs;
+  }
+  net->batch_index = b;
+}
+
+int NumDetectionHeads(Network* net)
+{
+  int num_heads = 0;
+  for (int i = 0; i < net->n; ++i)
+  {
+    if (IsDetectionHead(&net->layers[i]))
+      ++num_heads;
+  }
+  return num_heads;
+}
+
+// Bit k of the mask enables the k-th detection head in cfg order. Layers whose
+// outputs reach only disabled heads are marked in net->skip_layers and are not
+// evaluated by ForwardNetwork() during inference.
+void SetDetectionHeadMask(Network* net, uint32_t mask)
+{
+  if (net->skip_layers == nullptr)
+    net->skip_layers = (int*)xcalloc(net->n, sizeof(int));
+  net->inc_valid = 0;
+
+  // a route layer reads only its input layers, every other layer reads the
+  // output of the previous one
+  std::vector<bool> consumed(net->n, false);
+  for (int i = 1; i < net->n; ++i)
+  {
+    layer const* l = &net->layers[i];
+    if (l->type == ROUTE)
+    {
+      for (int k = 0; k < l->n; ++k)
+      {
+        consumed[l->input_layers[k]] = true;
+      }
+    }
+    else
+    {
+      consumed[i - 1] = true;
+    }
+  }
+
+  // a layer is needed if it is an enabled head or if any of its consumers is
+  // needed; consumers always come after their inputs in cfg order
+  std::vector<bool> needed(net->n, false);
+  int head_idx = NumDetectionHeads(net);
+  for (int i = net->n - 1; i >= 0; --i)
+  {
+    layer const* l = &net->layers[i];
+    if (IsDetectionHead(l))
+      needed[i] = (mask >> --head_idx) & 1;
+    else if (!consumed[i])
+      needed[i] = true;  // network output or dangling layer, keep it
+
+    net->skip_layers[i] = !needed[i];
+    if (!needed[i])
+      continue;
+
+    if (l->type == ROUTE)
+    {
+      for (int k = 0; k < l->n; ++k)
+      {
+        needed[l->input_layers[k]] = true;
+      }
+      continue;
+    }
+
+    if (i > 0)
+      needed[i - 1] = true;
+
+    if (l->type == SHORTCUT)
+    {
+      for (int k = 0; k < l->n; ++k)
+      {
+        needed[l->input_layers[k]] = true;
+      }
+    }
+    else if (l->type == SCALE_CHANNELS)
+    {
+      needed[l->index] = true;
+    }
+  }
+}
+
 int NumDetections(Network* net, float thresh)
 {
   int s = 0;
   for (int i = 0; i < net->n; ++i)
   {
+    if (net->skip_layers && net->skip_layers[i])
+      continue;
+
     layer const* l = &net->layers[i];
-    if (l->type == YOLO)
+    if (l->type == YOLO && net->fused_decode)
+      s += FusedYoloNumDetections(l, thresh);
+    else if (l->type == YOLO)
       s += YoloNumDetections(l, thresh);
 
     if (l->type == GAUSSIAN_YOLO)
@@ -447,14 +571,10 @@ int NumDetections(Network* net, float thresh)
   return s;
 }
 
-Detection* MakeNetworkBoxes(Network* net, float thresh, int* num)
+static Detection* AllocateDetections(Network* net, int num_boxes)
 {
   layer* l = &net->layers[net->n - 1];
 
-  int num_boxes = NumDetections(net, thresh);
-  if (num != NULL)
-    *num = num_boxes;
-
   Detection* dets = (Detection*)xcalloc(num_boxes, sizeof(Detection));
   for (int i = 0; i < num_boxes; ++i)
   {
@@ -470,12 +590,29 @@ Detection* MakeNetworkBoxes(Network* net, float thresh, int* num)
   return dets;
 }
 
+Detection* MakeNetworkBoxes(Network* net, float thresh, int* num)
+{
+  int num_boxes = NumDetections(net, thresh);
+  if (num != NULL)
+    *num = num_boxes;
+
+  return AllocateDetections(net, num_boxes);
+}
+
 void FillNetworkBoxes(Network* net, float thresh, Detection* dets)
 {
   for (int i = 0; i < net->n; ++i)
   {
+    if (net->skip_layers && net->skip_layers[i])
+      continue;
+
     layer* l = &net->layers[i];
-    if (l->type == YOLO)
+    if (l->type == YOLO && net->fused_decode)
+    {
+      int count = GetFusedYoloDetections(l, net->w, net->h, thresh, dets);
+      dets += count;
+    }
+    else if (l->type == YOLO)
     {
       int count = GetYoloDetections(l, net->w, net->h, thresh, dets);
       dets += count;
@@ -502,6 +639,66 @@ Detection* GetNetworkBoxes(Network* net, float thresh, int* num)
   return dets;
 }
 
+// cells of all detection heads, the size of the decode buffers
+static int MaxNetworkDetections(Network* net)
+{
+  int max_dets = 0;
+  for (int i = 0; i < net->n; ++i)
+  {
+    layer const* l = &net->layers[i];
+    if (IsDetectionHead(l))
+      max_dets += l->w * l->h * l->n;
+  }
+  return max_dets;
+}
+
+static void ReserveDecodeDetections(Network* net, int max_dets)
+{
+  if (max_dets > net->max_decode_dets)
+  {
+    if (net->decode_dets != nullptr)
+      FreeDetections(net->decode_dets, net->max_decode_dets);
+
+    net->decode_dets = AllocateDetections(net, max_dets);
+    net->max_decode_dets = max_dets;
+  }
+}
+
+// Decodes all detection heads in a single pass into a buffer owned by the
+// network, sized for every cell of every head. The returned detections stay
+// valid until the next call and must not be freed by the caller.
+Detection* DecodeNetworkBoxes(Network* net, float thresh, int* num)
+{
+  ReserveDecodeDetections(net, MaxNetworkDetections(net));
+
+  Detection* dets = net->decode_dets;
+  for (int i = 0; i < net->n; ++i)
+  {
+    if (net->skip_layers && net->skip_layers[i])
+      continue;
+
+    layer* l = &net->layers[i];
+    if (l->type == YOLO && net->fused_decode)
+      dets += GetFusedYoloDetections(l, net->w, net->h, thresh, dets);
+    else if (l->type == YOLO)
+      dets += GetYoloDetections(l, net->w, net->h, thresh, dets);
+
+    if (l->type == GAUSSIAN_YOLO)
+      dets += GetGaussianYoloDetections(l, net->w, net->h, thresh, dets);
+
+    if (l->type == DETECTION)
+    {
+      GetDetectionDetections(l, net->w, net->h, thresh, dets);
+      dets += l->w * l->h * l->n;
+    }
+  }
+
+  if (num != NULL)
+    *num = (int)(dets - net->decode_dets);
+
+  return net->decode_dets;
+}
+
 void FreeDetections(Detection* dets, int n)
 {
   for (int i = 0; i < n; ++i)
@@ -515,6 +712,184 @@ void FreeDetections(Detection* dets, int n)
   free(dets);
 }
 
+// Keeps the top_k classes of dense detections, dropping empty detections
+static int SparsifyDetections(Detection const* dets, int num_dets, float thresh,
+    int top_k, SparseDetection* sparse, ClassProb* pool)
+{
+  int count = 0;
+  for (int i = 0; i < num_dets; ++i)
+  {
+    SparseDetection& det = sparse[count];
+    det.probs = pool + count * top_k;
+    det.num_probs = 0;
+    for (int j = 0; j < dets[i].classes; ++j)
+    {
+      if (dets[i].prob[j] > thresh)
+        InsertClassProb(det.probs, &det.num_probs, top_k, j, dets[i].prob[j]);
+    }
+
+    if (det.num_probs > 0)
+    {
+      det.bbox = dets[i].bbox;
+      det.objectness = dets[i].objectness;
+      ++count;
+    }
+  }
+  return count;
+}
+
+// Decodes all detection heads into top-k sparse detections owned by the
+// network, like DecodeNetworkBoxes(). Yolo heads are decoded directly
+// without materializing dense class arrays.
+SparseDetection* GetSparseNetworkBoxes(
+    Network* net, float thresh, int top_k, int* num)
+{
+  top_k = max_val_cmp(top_k, 1);
+  int max_dets = MaxNetworkDetections(net);
+  if (max_dets > net->max_sparse_dets || top_k > net->sparse_top_k)
+  {
+    free(net->sparse_dets);
+    free(net->sparse_probs);
+    net->max_sparse_dets = max_val_cmp(max_dets, net->max_sparse_dets);
+    net->sparse_top_k = max_val_cmp(top_k, net->sparse_top_k);
+    net->sparse_dets = (SparseDetection*)xcalloc(
+        net->max_sparse_dets, sizeof(SparseDetection));
+    net->sparse_probs = (ClassProb*)xcalloc(
+        net->max_sparse_dets * net->sparse_top_k, sizeof(ClassProb));
+  }
+
+  int count = 0;
+  for (int i = 0; i < net->n; ++i)
+  {
+    if (net->skip_layers && net->skip_layers[i])
+      continue;
+
+    layer* l = &net->layers[i];
+    SparseDetection* dets = net->sparse_dets + count;
+    ClassProb* pool = net->sparse_probs + count * top_k;
+    if (l->type == YOLO)
+    {
+      count += GetSparseYoloDetections(l, net->w, net->h, thresh,
+          net->fused_decode, top_k, dets, pool);
+    }
+    else if (l->type == GAUSSIAN_YOLO || l->type == DETECTION)
+    {
+      // other heads are decoded densely and compacted
+      ReserveDecodeDetections(net, max_dets);
+      int num_dense = 0;
+      if (l->type == GAUSSIAN_YOLO)
+      {
+        num_dense = GetGaussianYoloDetections(
+            l, net->w, net->h, thresh, net->decode_dets);
+      }
+      else
+      {
+        GetDetectionDetections(l, net->w, net->h, thresh, net->decode_dets);
+        num_dense = l->w * l->h * l->n;
+      }
+      count += SparsifyDetections(
+          net->decode_dets, num_dense, thresh, top_k, dets, pool);
+    }
+  }
+
+  if (num != NULL)
+    *num = count;
+
+  return net->sparse_dets;
+}
+
+namespace
+{
+// function get_network_boxes() has already filtred dets by actual threshold
+float const kSerializeThresh = 0.005f;
+
+bool ReserveDetBuffer(DetBuffer* buf, size_t extra)
+{
+  size_t needed = buf->size + extra + 1;  // keep room for the terminator
+  if (needed <= buf->capacity)
+    return true;
+
+  size_t capacity = max_val_cmp(buf->capacity * 2, (size_t)4096);
+  capacity = max_val_cmp(capacity, needed);
+  char* data = (char*)realloc(buf->data, capacity);
+  if (!data)
+    return false;
+
+  buf->data = data;
+  buf->capacity = capacity;
+  return true;
+}
+
+void AppendStr(DetBuffer* buf, char const* str, size_t len)
+{
+  memcpy(buf->data + buf->size, str, len);
+  buf->size += len;
+}
+
+void AppendStr(DetBuffer* buf, char const* str)
+{
+  AppendStr(buf, str, strlen(str));
+}
+
+void AppendInt(DetBuffer* buf, long long int val)
+{
+  buf->size += sprintf(buf->data + buf->size, "%lld", val);
+}
+
+// Same text as printf("%f") without parsing a format string; NaN, inf and
+// magnitudes of 1e9 and above take the slow path
+void AppendFloat(DetBuffer* buf, float f)
+{
+  double val = f;
+  if (!(fabs(val) < 1e9))
+  {
+    buf->size += sprintf(buf->data + buf->size, "%f", val);
+    return;
+  }
+
+  char* p = buf->data + buf->size;
+  if (signbit(val))
+  {
+    *p++ = '-';
+    val = -val;
+  }
+
+  // exact for floats below 1e9, so ties round to even just like printf
+  double scaled_val = val * 1e6;
+  uint64_t scaled = (uint64_t)scaled_val;
+  double frac = scaled_val - scaled;
+  if (frac > 0.5 || (frac == 0.5 && (scaled & 1)))
+    scaled++;
+  uint64_t ipart = scaled / 1000000;
+  uint64_t fpart = scaled % 1000000;
+
+  char digits[20];
+  int n = 0;
+  do
+  {
+    digits[n++] = '0' + ipart % 10;
+    ipart /= 10;
+  } while (ipart);
+  while (n)
+  {
+    *p++ = digits[--n];
+  }
+
+  *p++ = '.';
+  for (int k = 5; k >= 0; --k)
+  {
+    p[k] = '0' + fpart % 10;
+    fpart /= 10;
+  }
+  buf->size = p + 6 - buf->data;
+}
+
+bool IsShown(char** names, int class_id)
+{
+  return !names || strncmp(names[class_id], "dont_show", 9);
+}
+}  // namespace
+
 // JSON format:
 //{
 // "frame_id":8990,
@@ -528,72 +903,223 @@ void FreeDetections(Detection* dets, int n)
 // ]
 //},
 
-char* Detection2Json(Detection* dets, int nboxes, int classes, char** names,
-    long long int frame_id, char const* filename)
+namespace
+{
+// Calls fn(bbox, class_id, prob) for every class above the serialization
+// threshold until fn fails
+template <typename Fn>
+bool ForEachObject(Detection const* dets, int nboxes, int classes, Fn fn)
 {
-  const float thresh = 0.005;  // function get_network_boxes() has already
-                               // filtred dets by actual threshold
+  for (int i = 0; i < nboxes; ++i)
+  {
+    for (int j = 0; j < classes; ++j)
+    {
+      if (dets[i].prob[j] > kSerializeThresh &&
+          !fn(dets[i].bbox, j, dets[i].prob[j]))
+        return false;
+    }
+  }
+  return true;
+}
 
-  char* send_buf = (char*)calloc(1024, sizeof(char));
-  if (!send_buf)
-    return 0;
+template <typename Fn>
+bool ForEachObject(SparseDetection const* dets, int nboxes, int classes, Fn fn)
+{
+  for (int i = 0; i < nboxes; ++i)
+  {
+    for (int s = 0; s < dets[i].num_probs; ++s)
+    {
+      ClassProb const& cp = dets[i].probs[s];
+      if (cp.cid < classes && cp.prob > kSerializeThresh &&
+          !fn(dets[i].bbox, cp.cid, cp.prob))
+        return false;
+    }
+  }
+  return true;
+}
+
+// Appends a frame to buf in a single pass; on failure buf keeps its contents
+template <typename Det>
+bool AppendJson(DetBuffer* buf, Det const* dets, int nboxes, int classes,
+    char** names, long long int frame_id, char const* filename)
+{
+  size_t const start = buf->size;
+
+  std::vector<char> show(classes);
+  std::vector<size_t> name_len(classes);
+  for (int j = 0; j < classes; ++j)
+  {
+    show[j] = IsShown(names, j);
+    name_len[j] = names ? strlen(names[j]) : 0;
+  }
 
+  if (!ReserveDetBuffer(buf, (filename ? strlen(filename) : 0) + 128))
+    return false;
+
+  AppendStr(buf, "{\n \"frame_id\":");
+  AppendInt(buf, frame_id);
   if (filename)
   {
-    sprintf(send_buf,
-        "{\n \"frame_id\":%lld, \n \"filename\":\"%s\", \n \"objects\": [ \n",
-        frame_id, filename);
+    AppendStr(buf, ", \n \"filename\":\"");
+    AppendStr(buf, filename);
+    AppendStr(buf, "\"");
   }
-  else
+  AppendStr(buf, ", \n \"objects\": [ \n");
+
+  bool first = true;
+  bool ok = ForEachObject(
+      dets, nboxes, classes, [&](Box const& b, int j, float prob) {
+        if (!show[j])
+          return true;
+
+        // fixed text, integer and five floats of at most 48 chars each
+        if (!ReserveDetBuffer(buf, name_len[j] + 512))
+          return false;
+
+        if (!first)
+          AppendStr(buf, ", \n");
+        first = false;
+
+        AppendStr(buf, "  {\"class_id\":");
+        AppendInt(buf, j);
+        // without names the class id stands for the name
+        AppendStr(buf, ", \"name\":\"");
+        if (names)
+          AppendStr(buf, names[j], name_len[j]);
+        else
+          AppendInt(buf, j);
+        AppendStr(buf, "\", \"relative_coordinates\":{\"center_x\":");
+        AppendFloat(buf, b.x);
+        AppendStr(buf, ", \"center_y\":");
+        AppendFloat(buf, b.y);
+        AppendStr(buf, ", \"width\":");
+        AppendFloat(buf, b.w);
+        AppendStr(buf, ", \"height\":");
+        AppendFloat(buf, b.h);
+        AppendStr(buf, "}, \"confidence\":");
+        AppendFloat(buf, prob);
+        AppendStr(buf, "}");
+        return true;
+      });
+
+  if (!ok || !ReserveDetBuffer(buf, 16))
   {
-    sprintf(send_buf, "{\n \"frame_id\":%lld, \n \"objects\": [ \n", frame_id);
+    buf->size = start;
+    return false;
   }
+  AppendStr(buf, "\n ] \n}");
+  buf->data[buf->size] = '\0';
 
-  int class_id = -1;
-  for (int i = 0; i < nboxes; ++i)
+  return true;
+}
+
+// Appends a DetFrameHeader and one DetRecord per shown class above the
+// serialization threshold; names may be null to keep every class
+template <typename Det>
+bool AppendBinary(DetBuffer* buf, Det const* dets, int nboxes, int classes,
+    char** names, long long int frame_id)
+{
+  size_t const start = buf->size;
+  if (!ReserveDetBuffer(buf, sizeof(DetFrameHeader)))
+    return false;
+  buf->size += sizeof(DetFrameHeader);
+
+  std::vector<char> show(classes);
+  for (int j = 0; j < classes; ++j)
   {
-    for (int j = 0; j < classes; ++j)
-    {
-      int show = strncmp(names[j], "dont_show", 9);
-      if (dets[i].prob[j] > thresh && show)
-      {
-        if (class_id != -1)
-          strcat(send_buf, ", \n");
-
-        class_id = j;
-        char* buf = (char*)calloc(2048, sizeof(char));
-        if (!buf)
-          return 0;
-
-        sprintf(buf,
-            "  {\"class_id\":%d, \"name\":\"%s\", "
-            "\"relative_coordinates\":{\"center_x\":%f, \"center_y\":%f, "
-            "\"width\":%f, \"height\":%f}, \"confidence\":%f}",
-            j, names[j], dets[i].bbox.x, dets[i].bbox.y, dets[i].bbox.w,
-            dets[i].bbox.h, dets[i].prob[j]);
-
-        int send_buf_len = strlen(send_buf);
-        int buf_len = strlen(buf);
-        int total_len = send_buf_len + buf_len + 100;
-        send_buf = (char*)realloc(send_buf, total_len * sizeof(char));
-        if (!send_buf)
-        {
-          if (buf)
-            free(buf);
-          return 0;
-        }
-        strcat(send_buf, buf);
-        free(buf);
-      }
-    }
+    show[j] = IsShown(names, j);
+  }
+
+  int32_t num_objects = 0;
+  bool ok = ForEachObject(
+      dets, nboxes, classes, [&](Box const& b, int j, float prob) {
+        if (!show[j])
+          return true;
+
+        if (!ReserveDetBuffer(buf, sizeof(DetRecord)))
+          return false;
+
+        DetRecord rec;
+        rec.class_id = j;
+        rec.x = b.x;
+        rec.y = b.y;
+        rec.w = b.w;
+        rec.h = b.h;
+        rec.confidence = prob;
+        memcpy(buf->data + buf->size, &rec, sizeof(DetRecord));
+        buf->size += sizeof(DetRecord);
+        num_objects++;
+        return true;
+      });
+
+  if (!ok)
+  {
+    buf->size = start;
+    return false;
   }
-  strcat(send_buf, "\n ] \n}");
 
-  return send_buf;
+  DetFrameHeader header;
+  header.frame_id = frame_id;
+  header.num_objects = num_objects;
+  header.reserved = 0;
+  memcpy(buf->data + start, &header, sizeof(DetFrameHeader));
+
+  return true;
+}
+}  // namespace
+
+bool AppendDetectionJson(DetBuffer* buf, Detection* dets, int nboxes,
+    int classes, char** names, long long int frame_id, char const* filename)
+{
+  return AppendJson(buf, dets, nboxes, classes, names, frame_id, filename);
+}
+
+bool AppendSparseDetectionJson(DetBuffer* buf, SparseDetection* dets,
+    int nboxes, int classes, char** names, long long int frame_id,
+    char const* filename)
+{
+  return AppendJson(buf, dets, nboxes, classes, names, frame_id, filename);
+}
+
+bool AppendDetectionBinary(DetBuffer* buf, Detection* dets, int nboxes,
+    int classes, char** names, long long int frame_id)
+{
+  return AppendBinary(buf, dets, nboxes, classes, names, frame_id);
+}
+
+bool AppendSparseDetectionBinary(DetBuffer* buf, SparseDetection* dets,
+    int nboxes, int classes, char** names, long long int frame_id)
+{
+  return AppendBinary(buf, dets, nboxes, classes, names, frame_id);
+}
+
+void FreeDetBuffer(DetBuffer* buf)
+{
+  free(buf->data);
+  buf->data = nullptr;
+  buf->size = 0;
+  buf->capacity = 0;
+}
+
+// Returned string is released by free()
+char* Detection2Json(Detection* dets, int nboxes, int classes, char** names,
+    long long int frame_id, char const* filename)
+{
+  DetBuffer buf = {nullptr, 0, 0};
+  if (!AppendDetectionJson(
+          &buf, dets, nboxes, classes, names, frame_id, filename))
+  {
+    FreeDetBuffer(&buf);
+    return 0;
+  }
+
+  return buf.data;
 }
 
 void FreeNetwork(Network* net)
 {
+  SelectNetworkBatch(net, 0);
+
   for (int i = 0; i < net->n; ++i)
   {
     free_layer(&net->layers[i]);
@@ -602,6 +1128,12 @@ void FreeNetwork(Network* net)
 
   free(net->scales);
   free(net->steps);
+  free(net->skip_layers);
+  free(net->inc_input);
+  if (net->decode_dets != nullptr)
+    FreeDetections(net->decode_dets, net->max_decode_dets);
+  free(net->sparse_dets);
+  free(net->sparse_probs);
 
 #ifdef GPU
   if (cuda_get_device() >= 0)
@@ -31,7 +31,6 @@ float TrainNetworkDatum(Network* net, float* x, float* y);
 float* GetNetworkOutput(Network* net);
 int GetNetworkInputSize(Network* net);
 int GetNetworkOutputSize(Network* net);
-void ResizeNetwork(Network* net, int w, int h);
 float GetNetworkCost(Network* net);
 
 void CopyNetWeights(Network* net_train, Network* net_map);
@@ -67,6 +67,9 @@ void ForwardNetworkGpu(Network* net, NetworkState state)
     if (l->delta_gpu && state.train)
       fill_ongpu(l->outputs * l->batch, 0, l->delta_gpu, 1);
 
+    if (!state.train && net->skip_layers && net->skip_layers[i])
+      continue;
+
     if (net->benchmark_layers)
       start_time = GetTimePoint();
 
@@ -378,6 +378,12 @@ void ParseYolo(layer* l, list* options, SizeParams params)
     l->nms_kind = GREEDY_NMS;
   else if (strcmp(nms_kind, "diounms") == 0)
     l->nms_kind = DIOU_NMS;
+  else if (strcmp(nms_kind, "gridnms") == 0)
+    l->nms_kind = GRID_NMS;
+  else if (strcmp(nms_kind, "fastnms") == 0)
+    l->nms_kind = FAST_NMS;
+  else if (strcmp(nms_kind, "matrixnms") == 0)
+    l->nms_kind = MATRIX_NMS;
   else
     l->nms_kind = GREEDY_NMS;
   printf("nms_kind: %s (%d), beta = %f \n", nms_kind, l->nms_kind, l->beta_nms);
@@ -506,6 +512,12 @@ void ParseGaussianYolo(layer* l, list* options, SizeParams params)
     l->nms_kind = GREEDY_NMS;
   else if (strcmp(nms_kind, "diounms") == 0)
     l->nms_kind = DIOU_NMS;
+  else if (strcmp(nms_kind, "gridnms") == 0)
+    l->nms_kind = GRID_NMS;
+  else if (strcmp(nms_kind, "fastnms") == 0)
+    l->nms_kind = FAST_NMS;
+  else if (strcmp(nms_kind, "matrixnms") == 0)
+    l->nms_kind = MATRIX_NMS;
   else
     l->nms_kind = GREEDY_NMS;
   printf("nms_kind: %s (%d), beta = %f \n", nms_kind, l->nms_kind, l->beta_nms);
@@ -1073,7 +1085,8 @@ void SetTrainOnlyBn(Network* net)
   }
 }
 
-bool ParseNetworkCfg(Network* net, char const* filename, bool train)
+bool ParseNetworkCfg(
+    Network* net, char const* filename, bool train, int batch)
 {
   list* sections = ReadSections(filename);
   if (sections == nullptr)
@@ -1111,7 +1124,10 @@ bool ParseNetworkCfg(Network* net, char const* filename, bool train)
   params.w = net->w;
   params.c = net->c;
   params.inputs = net->inputs;
-  if (!train || net->batch < 1)
+  // inference takes as many images per forward pass as asked for
+  if (!train)
+    net->batch = batch;
+  if (net->batch < 1)
     net->batch = 1;
   params.batch = net->batch;
   params.net = net;
@@ -1850,13 +1866,13 @@ bool LoadWeights(Network* net, char const* filename)
 
 // load network & force - set batch size
 bool LoadNetwork(Network* net, char const* model_file, char const* weights_file,
-    bool train, bool clear)
+    bool train, bool clear, int batch)
 {
   bool ret = false;
   printf(" Try to load model: %s, weights: %s, clear = %d \n", model_file,
       weights_file, clear);
 
-  ret = ParseNetworkCfg(net, model_file, train);
+  ret = ParseNetworkCfg(net, model_file, train, batch);
   if (weights_file != nullptr)
   {
     printf(" Try to load weights: %s \n", weights_file);
@@ -2,7 +2,8 @@
 
 #include "network.h"
 
-bool ParseNetworkCfg(Network* net, char const* filename, bool train = false);
+bool ParseNetworkCfg(
+    Network* net, char const* filename, bool train = false, int batch = 1);
 void SaveWeights(Network* net, char const* filename);
 void SaveWeightsUpTo(Network* net, char const* filename, int cutoff);
 bool LoadWeights(Network* net, char const* filename);
@@ -0,0 +1,221 @@
+#include "preprocess.h"
+
+#include <stdint.h>
+
+#include <algorithm>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace
+{
+// Frame area inside the network input, the whole input unless letterboxed
+void FrameRect(int frame_w, int frame_h, int w, int h, bool letterbox,
+    int& left, int& top, int& rect_w, int& rect_h)
+{
+  rect_w = w;
+  rect_h = h;
+  if (letterbox)
+  {
+    if ((float)w / frame_w < (float)h / frame_h)
+      rect_h = std::max(1, frame_h * w / frame_w);
+    else
+      rect_w = std::max(1, frame_w * h / frame_h);
+  }
+  left = (w - rect_w) / 2;
+  top = (h - rect_h) / 2;
+}
+
+// Bilinear taps along one axis with pixel centers aligned like cv::resize:
+// dst pixel d reads src pixels lo[d] and hi[d] weighted by 1 - f[d] and f[d]
+void LinearTaps(int src_size, int dst_size, std::vector<int>& lo,
+    std::vector<int>& hi, std::vector<float>& f)
+{
+  lo.resize(dst_size);
+  hi.resize(dst_size);
+  f.resize(dst_size);
+
+  float scale = (float)src_size / dst_size;
+  for (int d = 0; d < dst_size; ++d)
+  {
+    float s = std::max((d + 0.5f) * scale - 0.5f, 0.0f);
+    int i = (int)s;
+    if (i >= src_size - 1)
+    {
+      lo[d] = hi[d] = src_size - 1;
+      f[d] = 0.0f;
+    }
+    else
+    {
+      lo[d] = i;
+      hi[d] = i + 1;
+      f[d] = s - i;
+    }
+  }
+}
+
+inline float Lerp(float a, float b, float t) { return a + t * (b - a); }
+
+// Samples columns [begin, end) of one output row of a BGR frame; x0 and x1
+// are byte offsets of the taps within the source rows r0 and r1
+void SampleRow(uint8_t const* r0, uint8_t const* r1, float fy, int const* x0,
+    int const* x1, float const* fx, int begin, int end, float* const* planes)
+{
+  float const norm = 1.0f / 255.0f;
+  for (int x = begin; x < end; ++x)
+  {
+    for (int k = 0; k < 3; ++k)
+    {
+      float top = Lerp(r0[x0[x] + k], r0[x1[x] + k], fx[x]);
+      float bottom = Lerp(r1[x0[x] + k], r1[x1[x] + k], fx[x]);
+      planes[2 - k][x] = Lerp(top, bottom, fy) * norm;
+    }
+  }
+}
+
+#ifdef __AVX2__
+inline __m256 Channel(__m256i pixels, int k)
+{
+  __m256i v = _mm256_srl_epi32(pixels, _mm_cvtsi32_si128(8 * k));
+  return _mm256_cvtepi32_ps(_mm256_and_si256(v, _mm256_set1_epi32(0xff)));
+}
+
+inline __m256 Lerp(__m256 a, __m256 b, __m256 t)
+{
+  return _mm256_add_ps(a, _mm256_mul_ps(t, _mm256_sub_ps(b, a)));
+}
+
+// Same as SampleRow, 8 columns at a time. One 32-bit gather per tap fetches
+// the 3 channels of a pixel and the first byte of the next one, so the taps
+// of the last source column are left to SampleRow.
+int SampleRowAvx2(uint8_t const* r0, uint8_t const* r1, float fy,
+    int const* x0, int const* x1, float const* fx, int end,
+    float* const* planes)
+{
+  __m256 const norm = _mm256_set1_ps(1.0f / 255.0f);
+  __m256 const wy = _mm256_set1_ps(fy);
+
+  int x = 0;
+  for (; x + 8 <= end; x += 8)
+  {
+    __m256i off0 = _mm256_loadu_si256((__m256i const*)(x0 + x));
+    __m256i off1 = _mm256_loadu_si256((__m256i const*)(x1 + x));
+    __m256 wx = _mm256_loadu_ps(fx + x);
+
+    __m256i p00 = _mm256_i32gather_epi32((int const*)r0, off0, 1);
+    __m256i p01 = _mm256_i32gather_epi32((int const*)r0, off1, 1);
+    __m256i p10 = _mm256_i32gather_epi32((int const*)r1, off0, 1);
+    __m256i p11 = _mm256_i32gather_epi32((int const*)r1, off1, 1);
+
+    for (int k = 0; k < 3; ++k)
+    {
+      __m256 top = Lerp(Channel(p00, k), Channel(p01, k), wx);
+      __m256 bottom = Lerp(Channel(p10, k), Channel(p11, k), wx);
+      _mm256_storeu_ps(
+          planes[2 - k] + x, _mm256_mul_ps(Lerp(top, bottom, wy), norm));
+    }
+  }
+  return x;
+}
+#endif
+}  // namespace
+
+void Mat2NetworkInput(
+    cv::Mat const& mat, int w, int h, Image* image, bool letterbox)
+{
+  if (mat.type() != CV_8UC3)
+  {
+    cv::Mat bgr;
+    cv::cvtColor(mat, bgr,
+        mat.channels() == 1 ? cv::COLOR_GRAY2BGR : cv::COLOR_BGRA2BGR);
+    Mat2NetworkInput(bgr, w, h, image, letterbox);
+    return;
+  }
+
+  if (image->data == nullptr)
+  {
+    image->w = w;
+    image->h = h;
+    image->c = 3;
+    image->data = new float[h * w * 3];
+  }
+
+  int left, top, rect_w, rect_h;
+  FrameRect(mat.cols, mat.rows, w, h, letterbox, left, top, rect_w, rect_h);
+
+  std::vector<int> x0, x1, y0, y1;
+  std::vector<float> fx, fy;
+  LinearTaps(mat.cols, rect_w, x0, x1, fx);
+  LinearTaps(mat.rows, rect_h, y0, y1, fy);
+
+  // columns before vec_end never read the last source column
+  int vec_end = 0;
+  while (vec_end < rect_w && x1[vec_end] < mat.cols - 1)
+  {
+    ++vec_end;
+  }
+
+  for (int x = 0; x < rect_w; ++x)
+  {
+    x0[x] *= 3;
+    x1[x] *= 3;
+  }
+
+  int const plane_size = w * h;
+#pragma omp parallel for
+  for (int y = 0; y < h; ++y)
+  {
+    float* planes[3];
+    for (int k = 0; k < 3; ++k)
+    {
+      planes[k] = image->data + k * plane_size + y * w;
+    }
+
+    int ry = y - top;
+    if (ry < 0 || ry >= rect_h)
+    {
+      for (int k = 0; k < 3; ++k)
+      {
+        std::fill(planes[k], planes[k] + w, 0.5f);
+      }
+      continue;
+    }
+
+    for (int k = 0; k < 3; ++k)
+    {
+      std::fill(planes[k], planes[k] + left, 0.5f);
+      std::fill(planes[k] + left + rect_w, planes[k] + w, 0.5f);
+      planes[k] += left;
+    }
+
+    uint8_t const* r0 = mat.ptr<uint8_t>(y0[ry]);
+    uint8_t const* r1 = mat.ptr<uint8_t>(y1[ry]);
+
+    int x = 0;
+#ifdef __AVX2__
+    x = SampleRowAvx2(r0, r1, fy[ry], &x0[0], &x1[0], &fx[0], vec_end, planes);
+#endif
+    SampleRow(r0, r1, fy[ry], &x0[0], &x1[0], &fx[0], x, rect_w, planes);
+  }
+}
+
+void CorrectLetterboxDets(std::vector<MostProbDet>& dets, int frame_w,
+    int frame_h, int w, int h)
+{
+  int left, top, rect_w, rect_h;
+  FrameRect(frame_w, frame_h, w, h, true, left, top, rect_w, rect_h);
+
+  float sx = (float)w / rect_w;
+  float sy = (float)h / rect_h;
+  float ox = (float)left / w;
+  float oy = (float)top / h;
+  for (size_t i = 0; i < dets.size(); ++i)
+  {
+    Box& b = dets[i].bbox;
+    b.x = (b.x - ox) * sx;
+    b.y = (b.y - oy) * sy;
+    b.w *= sx;
+    b.h *= sy;
+  }
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+#include "box.h"
+#include "image.h"
+#include "libapi.h"
+
+// Network input of a frame in one pass over it: bilinear resize to w x h,
+// channels reversed as by cv::COLOR_RGB2BGR, scaled to [0, 1] and stored
+// planar, replacing cv::resize, cv::cvtColor and Mat2Image. With letterbox
+// the frame keeps its aspect ratio and is centered on a 0.5 gray border.
+// Rows are split over threads and 8 columns are sampled at once on AVX2.
+// image->data is allocated on first use, like Mat2Image.
+LIB_API void Mat2NetworkInput(
+    cv::Mat const& mat, int w, int h, Image* image, bool letterbox = false);
+
+// Maps boxes relative to a letterboxed w x h input back to the frame
+LIB_API void CorrectLetterboxDets(std::vector<MostProbDet>& dets,
+    int frame_w, int frame_h, int w, int h);
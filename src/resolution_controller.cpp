@@ -0,0 +1,135 @@
+#include "resolution_controller.h"
+
+#include <stdlib.h>
+
+#include <algorithm>
+
+#include "utils.h"
+
+namespace yc
+{
+ResolutionController::ResolutionController(std::vector<cv::Size> const& sizes,
+    double budget_ms, int start, float min_object, int hold, float margin)
+    : sizes_(sizes),
+      budget_ms_(budget_ms),
+      min_object_(min_object),
+      hold_(max_val_cmp(hold, 1)),
+      margin_(max_val_cmp(margin, 1.0f)),
+      num_switches_(0)
+{
+  if (sizes_.empty())
+    sizes_.push_back(cv::Size(416, 416));
+
+  std::stable_sort(sizes_.begin(), sizes_.end(),
+      [](cv::Size const& a, cv::Size const& b) {
+        return a.width * a.height < b.width * b.height;
+      });
+
+  start_ = min_val_cmp(max_val_cmp(start, 0), (int)sizes_.size() - 1);
+  level_ = pending_ = start_;
+  pending_frames_ = 0;
+  forward_ms_.assign(sizes_.size(), 0.0);
+}
+
+double ResolutionController::ForwardTime(int level) const
+{
+  if (forward_ms_[level] > 0.0)
+    return forward_ms_[level];
+
+  // the closest measured size, scaled by the area ratio
+  int nearest = -1;
+  for (int i = 0; i < (int)sizes_.size(); i++)
+  {
+    if (forward_ms_[i] > 0.0 &&
+        (nearest < 0 || std::abs(i - level) < std::abs(nearest - level)))
+      nearest = i;
+  }
+  if (nearest < 0)
+    return 0.0;
+
+  double area = (double)sizes_[level].width * sizes_[level].height;
+  double nearest_area =
+      (double)sizes_[nearest].width * sizes_[nearest].height;
+  return forward_ms_[nearest] * area / nearest_area;
+}
+
+int ResolutionController::BudgetLevel() const
+{
+  if (budget_ms_ <= 0.0)
+    return (int)sizes_.size() - 1;
+
+  int level = 0;
+  for (int i = 1; i < (int)sizes_.size(); i++)
+  {
+    if (ForwardTime(i) <= budget_ms_)
+      level = i;
+  }
+  return level;
+}
+
+int ResolutionController::ObjectLevel(
+    std::vector<Box> const& objects, float scale_x, float scale_y) const
+{
+  if (objects.empty())
+    return start_;
+
+  // the object at the 10th percentile of sizes stands for the small ones,
+  // so that a few tiny false positives do not drive the choice
+  std::vector<Box> boxes(objects);
+  for (size_t i = 0; i < boxes.size(); i++)
+  {
+    boxes[i].w *= scale_x;
+    boxes[i].h *= scale_y;
+  }
+
+  cv::Size base = sizes_.front();
+  size_t k = boxes.size() / 10;
+  std::nth_element(boxes.begin(), boxes.begin() + k, boxes.end(),
+      [&base](Box const& a, Box const& b) {
+        return min_val_cmp(a.w * base.width, a.h * base.height) <
+               min_val_cmp(b.w * base.width, b.h * base.height);
+      });
+  Box const& small = boxes[k];
+
+  for (int i = 0; i < (int)sizes_.size(); i++)
+  {
+    float pixels = min_val_cmp(
+        small.w * sizes_[i].width, small.h * sizes_[i].height);
+    float needed = i < level_ ? margin_ * min_object_ : min_object_;
+    if (pixels >= needed)
+      return i;
+  }
+  return (int)sizes_.size() - 1;
+}
+
+bool ResolutionController::Update(double forward_ms,
+    std::vector<Box> const& objects, float scale_x, float scale_y)
+{
+  double& average = forward_ms_[level_];
+  average = average > 0.0 ? 0.9 * average + 0.1 * forward_ms : forward_ms;
+
+  int target =
+      min_val_cmp(ObjectLevel(objects, scale_x, scale_y), BudgetLevel());
+  if (target == level_)
+  {
+    pending_frames_ = 0;
+    return false;
+  }
+
+  if (target != pending_)
+  {
+    pending_ = target;
+    pending_frames_ = 0;
+  }
+
+  // a size far over budget is left at once
+  bool overrun = budget_ms_ > 0.0 && average > margin_ * budget_ms_;
+  if (++pending_frames_ < hold_ && !(overrun && target < level_))
+    return false;
+
+  level_ = target;
+  pending_frames_ = 0;
+  num_switches_++;
+  return true;
+}
+}  // namespace yc
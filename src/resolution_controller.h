@@ -0,0 +1,63 @@
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+#include "box.h"
+#include "libapi.h"
+
+namespace yc
+{
+// Picks the network input size of a stream among a few preplanned ones. The
+// largest size whose forward time fits the latency budget bounds the choice;
+// within it, the smallest size showing the small objects of the scene with at
+// least min_object pixels wins, so scenes of large or near objects run small
+// and crowds of small objects run large. Forward times are averaged per size,
+// sizes not run yet being estimated from the measured ones by their area. A
+// new size is taken only after hold detector frames in a row asked for it,
+// and going down also needs the objects to stay margin times above
+// min_object, so the size does not oscillate.
+class LIB_API ResolutionController
+{
+ public:
+  // sizes are sorted by area; start is the index of the first size, usually
+  // the one of the cfg
+  ResolutionController(std::vector<cv::Size> const& sizes, double budget_ms,
+      int start = 0, float min_object = 16.0f, int hold = 15,
+      float margin = 1.5f);
+
+  // Feeds the forward time of a detector frame run at Size() and the boxes
+  // of the objects seen in it, relative to the frame; returns true if the
+  // next detector frame should run at another Size(). Without objects the
+  // start size is asked for. scale_x and scale_y tell how much larger objects
+  // are at the network input than with the whole frame stretched onto it, as
+  // when the network sees a crop or a tile of the frame, or a letterbox.
+  bool Update(double forward_ms, std::vector<Box> const& objects,
+      float scale_x = 1.0f, float scale_y = 1.0f);
+
+  cv::Size Size() const { return sizes_[level_]; }
+  int Level() const { return level_; }
+  int NumSwitches() const { return num_switches_; }
+
+  // averaged or estimated forward time at a size
+  double ForwardTime(int level) const;
+
+ private:
+  int BudgetLevel() const;
+  int ObjectLevel(
+      std::vector<Box> const& objects, float scale_x, float scale_y) const;
+
+  std::vector<cv::Size> sizes_;
+  double budget_ms_;
+  float min_object_;
+  int hold_;
+  float margin_;
+
+  int start_;
+  int level_;
+  int pending_;  // level asked for by the last frames
+  int pending_frames_;
+  int num_switches_;
+
+  std::vector<double> forward_ms_;  // moving averages, 0 if never run
+};
+}  // namespace yc
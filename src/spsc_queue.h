@@ -0,0 +1,153 @@
+#pragma once
+#include <stddef.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace yc
+{
+// Bounded ring buffer between exactly one producer thread and one consumer
+// thread. TryPush/TryPop never block and only take the lock to wake a blocked
+// end; Push/Pop yield a few times while the queue is full or empty and then
+// sleep until the other end pops, pushes or closes. Once the producer calls
+// Close(), Pop drains what is left and then returns false.
+template <typename T>
+class SpscQueue
+{
+ public:
+  explicit SpscQueue(size_t capacity)
+      : buf_(capacity + 1), head_(0), tail_(0), closed_(false), waiters_(0)
+  {
+  }
+
+  bool TryPush(T const& item)
+  {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    size_t next = Next(tail);
+    if (next == head_.load(std::memory_order_acquire))
+      return false;
+
+    buf_[tail] = item;
+    tail_.store(next, std::memory_order_release);
+    Notify();
+    return true;
+  }
+
+  bool TryPop(T& item)
+  {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire))
+      return false;
+
+    item = buf_[head];
+    head_.store(Next(head), std::memory_order_release);
+    Notify();
+    return true;
+  }
+
+  // false only if the queue was closed while full
+  bool Push(T const& item)
+  {
+    for (int spin = 0; !TryPush(item); spin++)
+    {
+      if (closed_.load(std::memory_order_acquire))
+        return false;
+
+      if (spin < kSpins)
+        std::this_thread::yield();
+      else
+        Wait([this]() { return !Full() || Closed(); });
+    }
+    return true;
+  }
+
+  // false once the queue is closed and empty
+  bool Pop(T& item)
+  {
+    for (int spin = 0; !TryPop(item); spin++)
+    {
+      // an item pushed right before Close() is still taken
+      if (closed_.load(std::memory_order_acquire))
+        return TryPop(item);
+
+      if (spin < kSpins)
+        std::this_thread::yield();
+      else
+        Wait([this]() { return !Empty() || Closed(); });
+    }
+    return true;
+  }
+
+  void Close()
+  {
+    closed_.store(true, std::memory_order_release);
+    Notify();
+  }
+
+  // exact from either end, a snapshot from any other thread
+  size_t Size() const
+  {
+    size_t head = head_.load(std::memory_order_acquire);
+    size_t tail = tail_.load(std::memory_order_acquire);
+    return (tail + buf_.size() - head) % buf_.size();
+  }
+
+  size_t Capacity() const { return buf_.size() - 1; }
+
+ private:
+  // yields before sleeping, enough to ride out a short stall of the other end
+  static int const kSpins = 64;
+
+  size_t Next(size_t idx) const { return idx + 1 == buf_.size() ? 0 : idx + 1; }
+
+  bool Empty() const
+  {
+    return head_.load(std::memory_order_acquire) ==
+           tail_.load(std::memory_order_acquire);
+  }
+  bool Full() const
+  {
+    return Next(tail_.load(std::memory_order_acquire)) ==
+           head_.load(std::memory_order_acquire);
+  }
+  bool Closed() const { return closed_.load(std::memory_order_acquire); }
+
+  // The waiter announces itself before checking ready under the lock, and a
+  // notifier checks for waiters after its store, the fences ordering both, so
+  // either the waiter sees the store or the notifier sees the waiter.
+  template <typename Ready>
+  void Wait(Ready ready)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    waiters_.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    cond_.wait(lock, ready);
+    waiters_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  void Notify()
+  {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiters_.load(std::memory_order_relaxed) == 0)
+      return;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    cond_.notify_all();
+  }
+
+  std::vector<T> buf_;  // one slot stays empty to tell full from empty
+
+  // producer and consumer indices on separate cache lines
+  alignas(64) std::atomic<size_t> head_;
+  alignas(64) std::atomic<size_t> tail_;
+  std::atomic<bool> closed_;
+
+  // only touched once an end runs out of spins
+  std::atomic<int> waiters_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+};
+}  // namespace yc
@@ -0,0 +1,162 @@
+#include "tiling.h"
+
+#include <algorithm>
+
+namespace
+{
+// Starts and sizes of n segments of length size covering [begin, begin + len)
+void Segments(int begin, int len, int n, float overlap, std::vector<int>& pos,
+    std::vector<int>& size)
+{
+  pos.resize(n);
+  size.resize(n);
+
+  float tile = len / (n - (n - 1) * overlap);
+  float step = tile * (1.0f - overlap);
+  for (int i = 0; i < n; ++i)
+  {
+    int start = (int)(i * step + 0.5f);
+    int end = i == n - 1 ? len : std::min((int)(i * step + tile + 0.5f), len);
+    pos[i] = begin + start;
+    size[i] = std::max(end - start, 1);
+  }
+}
+
+// Box of a tile relative to the frame
+Box TileBox(cv::Rect const& tile, int frame_w, int frame_h)
+{
+  return Box((tile.x + tile.width / 2.0f) / frame_w,
+      (tile.y + tile.height / 2.0f) / frame_h, (float)tile.width / frame_w,
+      (float)tile.height / frame_h);
+}
+
+// Whether a and b, seen by tiles ta and tb, are the same object cut by their
+// seam: their intersection lies in the band shared by the tiles, up to slack
+// for boxes ending on a tile border, and exceeds thresh of the smaller box
+bool SeamDuplicate(Box const& a, Box const& b, Box const& ta, Box const& tb,
+    float thresh, float slack_x, float slack_y)
+{
+  float smaller = std::min(a.w * a.h, b.w * b.h);
+  if (smaller <= 0 || Box::Intersect(a, b) <= thresh * smaller)
+    return false;
+
+  Box::AbsBox p(a), q(b), s(ta), t(tb);
+  return std::max(p.left, q.left) >= std::max(s.left, t.left) - slack_x &&
+         std::min(p.right, q.right) <= std::min(s.right, t.right) + slack_x &&
+         std::max(p.top, q.top) >= std::max(s.top, t.top) - slack_y &&
+         std::min(p.bottom, q.bottom) <=
+             std::min(s.bottom, t.bottom) + slack_y;
+}
+}  // namespace
+
+std::vector<cv::Rect> TileRects(
+    cv::Rect const& area, int cols, int rows, float overlap)
+{
+  cols = std::max(cols, 1);
+  rows = std::max(rows, 1);
+  overlap = std::min(std::max(overlap, 0.0f), 0.9f);
+
+  std::vector<int> x, w, y, h;
+  Segments(area.x, area.width, cols, overlap, x, w);
+  Segments(area.y, area.height, rows, overlap, y, h);
+
+  std::vector<cv::Rect> tiles;
+  for (int r = 0; r < rows; ++r)
+  {
+    for (int c = 0; c < cols; ++c)
+    {
+      tiles.push_back(cv::Rect(x[c], y[r], w[c], h[r]));
+    }
+  }
+  return tiles;
+}
+
+void TileDetsToFrame(std::vector<MostProbDet>& dets, cv::Rect const& tile,
+    int frame_w, int frame_h)
+{
+  for (size_t i = 0; i < dets.size(); ++i)
+  {
+    Box& b = dets[i].bbox;
+    b.x = (tile.x + b.x * tile.width) / frame_w;
+    b.y = (tile.y + b.y * tile.height) / frame_h;
+    b.w = b.w * tile.width / frame_w;
+    b.h = b.h * tile.height / frame_h;
+  }
+}
+
+void MergeTileDets(std::vector<MostProbDet>& dets,
+    std::vector<int> const& det_tiles, std::vector<cv::Rect> const& tiles,
+    int frame_w, int frame_h, float thresh)
+{
+  int n = (int)dets.size();
+  int classes = 0;
+  for (int i = 0; i < n; ++i)
+  {
+    classes = std::max(classes, dets[i].cid + 1);
+  }
+
+  std::vector<ClassProb> probs(n);
+  std::vector<SparseDetection> sparse(n);
+  for (int i = 0; i < n; ++i)
+  {
+    probs[i].cid = dets[i].cid;
+    probs[i].prob = dets[i].prob;
+    sparse[i].bbox = dets[i].bbox;
+    sparse[i].objectness = dets[i].prob;
+    sparse[i].num_probs = 1;
+    sparse[i].probs = &probs[i];
+  }
+  NmsSort(sparse.data(), n, classes, thresh, GREEDY_NMS, 0.0f);
+
+  std::vector<Box> tile_boxes;
+  for (size_t t = 0; t < tiles.size(); ++t)
+  {
+    tile_boxes.push_back(TileBox(tiles[t], frame_w, frame_h));
+  }
+
+  // survivors reaching into another tile, the only ones a seam can have cut
+  std::vector<int> seam;
+  for (int i = 0; i < n; ++i)
+  {
+    if (probs[i].prob <= 0)
+      continue;
+
+    for (int t = 0; t < (int)tiles.size(); ++t)
+    {
+      if (t != det_tiles[i] &&
+          Box::Intersect(dets[i].bbox, tile_boxes[t]) > 0)
+      {
+        seam.push_back(i);
+        break;
+      }
+    }
+  }
+
+  std::stable_sort(seam.begin(), seam.end(),
+      [&dets](int a, int b) { return dets[a].prob > dets[b].prob; });
+  for (size_t i = 0; i < seam.size(); ++i)
+  {
+    int a = seam[i];
+    if (probs[a].prob <= 0)
+      continue;
+
+    for (size_t j = i + 1; j < seam.size(); ++j)
+    {
+      int b = seam[j];
+      if (probs[b].prob > 0 && dets[b].cid == dets[a].cid &&
+          det_tiles[b] != det_tiles[a] &&
+          SeamDuplicate(dets[a].bbox, dets[b].bbox,
+              tile_boxes[det_tiles[a]], tile_boxes[det_tiles[b]], thresh,
+              1.0f / frame_w, 1.0f / frame_h))
+        probs[b].prob = 0;
+    }
+  }
+
+  std::vector<MostProbDet> kept;
+  for (int i = 0; i < n; ++i)
+  {
+    if (probs[i].prob > 0)
+      kept.push_back(dets[i]);
+  }
+  dets.swap(kept);
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+#include "box.h"
+#include "libapi.h"
+
+// Frame areas of a cols x rows grid of tiles covering area, neighbouring tiles
+// sharing overlap of their size so that an object cut by a seam is whole in at
+// least one of them as long as it is smaller than the shared band
+LIB_API std::vector<cv::Rect> TileRects(
+    cv::Rect const& area, int cols, int rows, float overlap);
+
+// Maps boxes relative to a tile to boxes relative to the frame
+LIB_API void TileDetsToFrame(std::vector<MostProbDet>& dets,
+    cv::Rect const& tile, int frame_w, int frame_h);
+
+// NMS over the detections of all tiles of a frame, det_tiles[i] being the
+// index in tiles of the one dets[i] was seen in. Boxes of a class go through
+// the greedy IoU NMS; then of two boxes seen in different tiles whose
+// intersection lies in the band the tiles share, the less probable one is
+// also dropped when their intersection exceeds thresh of the smaller box, so
+// that the part of an object cut by a seam goes along with the whole object
+// without dropping crowded objects seen in a single tile.
+LIB_API void MergeTileDets(std::vector<MostProbDet>& dets,
+    std::vector<int> const& det_tiles, std::vector<cv::Rect> const& tiles,
+    int frame_w, int frame_h, float thresh);
@@ -0,0 +1,252 @@
+#include "track_log.h"
+
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "track_manager.h"
+
+namespace yc
+{
+namespace
+{
+uint32_t const kTrackLogVersion = 1;
+
+TrackLogHeader MakeHeader()
+{
+  TrackLogHeader header;
+  memcpy(header.magic, "YCTL", 4);
+  header.version = kTrackLogVersion;
+  header.record_size = sizeof(TrackRecord);
+  header.reserved = 0;
+  return header;
+}
+
+bool IsValidHeader(TrackLogHeader const& header)
+{
+  return memcmp(header.magic, "YCTL", 4) == 0 &&
+         header.version == kTrackLogVersion &&
+         header.record_size == sizeof(TrackRecord);
+}
+
+// Cuts the file open as fp down to size bytes
+bool TruncateFile(FILE* fp, long size)
+{
+#ifdef _WIN32
+  return _chsize_s(_fileno(fp), size) == 0;
+#else
+  return ftruncate(fileno(fp), size) == 0;
+#endif
+}
+}  // namespace
+
+TrackRecord MakeTrackRecord(Track const* track, int64_t end_frame)
+{
+  TrackRecord record;
+  Box box = track->GetBox();
+
+  record.start_frame = end_frame - track->GetCount() + 1;
+  record.end_frame = end_frame;
+  record.label = track->GetLabel();
+  record.class_id = track->GetClassId();
+  record.prob = track->GetClassProb();
+  record.x = box.x;
+  record.y = box.y;
+  record.w = box.w;
+  record.h = box.h;
+  record.flags = 0;
+  if (track->GetStatus() == STATIONARY)
+    record.flags |= TRACK_STATIONARY;
+  if (track->GetEnterStatus())
+    record.flags |= TRACK_ENTERED;
+  if (track->GetExitStatus())
+    record.flags |= TRACK_EXITED;
+
+  return record;
+}
+///
+
+///
+TrackLogWriter::TrackLogWriter() : fp_(nullptr) {}
+TrackLogWriter::~TrackLogWriter() { Close(); }
+
+bool TrackLogWriter::Open(std::string const& path)
+{
+  Close();
+
+  fp_ = fopen(path.c_str(), "ab");
+  if (fp_ == nullptr)
+  {
+    fprintf(stderr, "Couldn't open track log %s\n", path.c_str());
+    return false;
+  }
+
+  fseek(fp_, 0, SEEK_END);
+  long size = ftell(fp_);
+  if (size == 0)
+  {
+    TrackLogHeader header = MakeHeader();
+    if (fwrite(&header, sizeof(header), 1, fp_) != 1)
+    {
+      fprintf(stderr, "Couldn't write track log %s\n", path.c_str());
+      Close();
+      return false;
+    }
+    return true;
+  }
+
+  // appending to an existing log, check it's one of ours
+  TrackLogHeader header;
+  FILE* fp = fopen(path.c_str(), "rb");
+  bool valid = fp != nullptr && fread(&header, sizeof(header), 1, fp) == 1 &&
+               IsValidHeader(header);
+  if (fp != nullptr)
+    fclose(fp);
+
+  if (!valid)
+  {
+    fprintf(stderr, "%s isn't a compatible track log\n", path.c_str());
+    Close();
+    return false;
+  }
+
+  // a record torn by a crash would shift every record appended after it
+  long records = (size - (long)sizeof(header)) / (long)sizeof(TrackRecord);
+  long whole = (long)sizeof(header) + records * (long)sizeof(TrackRecord);
+  if (whole != size)
+  {
+    fprintf(stderr, "Dropping a partial record at the end of %s\n",
+        path.c_str());
+    if (!TruncateFile(fp_, whole))
+    {
+      fprintf(stderr, "Couldn't truncate track log %s\n", path.c_str());
+      Close();
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void TrackLogWriter::Close()
+{
+  if (fp_ != nullptr)
+    fclose(fp_);
+  fp_ = nullptr;
+}
+
+bool TrackLogWriter::Append(TrackRecord const& record)
+{
+  if (fp_ == nullptr)
+    return false;
+
+  return fwrite(&record, sizeof(record), 1, fp_) == 1;
+}
+
+void TrackLogWriter::Flush()
+{
+  if (fp_ != nullptr)
+    fflush(fp_);
+}
+///
+
+///
+TrackLogReader::TrackLogReader()
+    : base_(nullptr),
+      length_(0),
+#ifdef _WIN32
+      file_(INVALID_HANDLE_VALUE),
+      mapping_(nullptr),
+#endif
+      records_(nullptr),
+      num_records_(0)
+{
+}
+
+TrackLogReader::~TrackLogReader() { Close(); }
+
+bool TrackLogReader::Open(std::string const& path)
+{
+  Close();
+
+#ifdef _WIN32
+  file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+      OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  LARGE_INTEGER size;
+  if (file_ == INVALID_HANDLE_VALUE || !GetFileSizeEx(file_, &size))
+  {
+    fprintf(stderr, "Couldn't open track log %s\n", path.c_str());
+    Close();
+    return false;
+  }
+  length_ = (size_t)size.QuadPart;
+
+  if (length_ >= sizeof(TrackLogHeader))
+  {
+    mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping_ != nullptr)
+      base_ = MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+  }
+#else
+  int fd = open(path.c_str(), O_RDONLY);
+  struct stat info;
+  if (fd < 0 || fstat(fd, &info) != 0)
+  {
+    fprintf(stderr, "Couldn't open track log %s\n", path.c_str());
+    if (fd >= 0)
+      close(fd);
+    return false;
+  }
+  length_ = (size_t)info.st_size;
+
+  if (length_ >= sizeof(TrackLogHeader))
+  {
+    base_ = mmap(nullptr, length_, PROT_READ, MAP_SHARED, fd, 0);
+    if (base_ == MAP_FAILED)
+      base_ = nullptr;
+  }
+  close(fd);
+#endif
+
+  if (base_ == nullptr || !IsValidHeader(*(TrackLogHeader const*)base_))
+  {
+    fprintf(stderr, "%s isn't a compatible track log\n", path.c_str());
+    Close();
+    return false;
+  }
+
+  records_ = (TrackRecord const*)((char const*)base_ + sizeof(TrackLogHeader));
+  num_records_ = (length_ - sizeof(TrackLogHeader)) / sizeof(TrackRecord);
+  return true;
+}
+
+void TrackLogReader::Close()
+{
+#ifdef _WIN32
+  if (base_ != nullptr)
+    UnmapViewOfFile(base_);
+  if (mapping_ != nullptr)
+    CloseHandle(mapping_);
+  if (file_ != INVALID_HANDLE_VALUE)
+    CloseHandle(file_);
+  mapping_ = nullptr;
+  file_ = INVALID_HANDLE_VALUE;
+#else
+  if (base_ != nullptr)
+    munmap(base_, length_);
+#endif
+
+  base_ = nullptr;
+  length_ = 0;
+  records_ = nullptr;
+  num_records_ = 0;
+}
+}  // namespace yc
@@ -0,0 +1,92 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+
+#include "libapi.h"
+
+namespace yc
+{
+class Track;
+
+// Append-only binary log of finished tracks: a TrackLogHeader followed by
+// fixed-size TrackRecords in completion order, all little-endian as written
+typedef struct TrackLogHeader
+{
+  char magic[4];  // "YCTL"
+  uint32_t version;
+  uint32_t record_size;
+  uint32_t reserved;
+} TrackLogHeader;
+
+enum TRACK_RECORD_FLAG
+{
+  TRACK_STATIONARY = 1,
+  TRACK_ENTERED = 2,
+  TRACK_EXITED = 4
+};
+
+typedef struct TrackRecord
+{
+  int64_t start_frame;
+  int64_t end_frame;
+  int32_t label;
+  int32_t class_id;
+  float prob;
+  float x, y, w, h;  // last box
+  int32_t flags;     // TRACK_RECORD_FLAG bits
+} TrackRecord;
+
+LIB_API TrackRecord MakeTrackRecord(Track const* track, int64_t end_frame);
+
+class LIB_API TrackLogWriter
+{
+ public:
+  TrackLogWriter();
+  ~TrackLogWriter();
+
+  // Appends to an existing log, or starts a new one
+  bool Open(std::string const& path);
+  void Close();
+  bool IsOpen() const { return fp_ != nullptr; }
+
+  bool Append(TrackRecord const& record);
+  void Flush();
+
+ private:
+  TrackLogWriter(TrackLogWriter const&);
+  TrackLogWriter& operator=(TrackLogWriter const&);
+
+  FILE* fp_;
+};
+
+// Maps a log read-only; a record cut short by a crash is ignored
+class LIB_API TrackLogReader
+{
+ public:
+  TrackLogReader();
+  ~TrackLogReader();
+
+  bool Open(std::string const& path);
+  void Close();
+
+  size_t Size() const { return num_records_; }
+  TrackRecord const* Records() const { return records_; }
+  TrackRecord const& operator[](size_t i) const { return records_[i]; }
+
+ private:
+  TrackLogReader(TrackLogReader const&);
+  TrackLogReader& operator=(TrackLogReader const&);
+
+  void* base_;
+  size_t length_;
+#ifdef _WIN32
+  void* file_;
+  void* mapping_;
+#endif
+
+  TrackRecord const* records_;
+  size_t num_records_;
+};
+}  // namespace yc
@@ -1,36 +1,116 @@
 #include "track_manager.h"
 
+#include <float.h>
+#include <math.h>
+
+#include <algorithm>
 #include <deque>
 
-#include "hungarian/Hungarian.h"
+#include "box_batch.h"
+#include "kalman_store.h"
+#include "lapjv.h"
+#include "track_log.h"
 #include "utils.h"
 
 #define SQUARE(x) ((x) * (x))
 
 namespace yc
 {
+// Fixed-capacity history that overwrites its oldest box when full
+class BoxRing
+{
+ public:
+  BoxRing(int capacity = 1)
+      : boxes_(max_val_cmp(capacity, 1)), head_(0), size_(0)
+  {
+  }
+
+  void Push(Box const& b)
+  {
+    int const capacity = (int)boxes_.size();
+    boxes_[(head_ + size_) % capacity] = b;
+    if (size_ < capacity)
+      size_++;
+    else
+      head_ = (head_ + 1) % capacity;
+  }
+
+  int Size() const { return size_; }
+  Box const& Front() const { return boxes_[head_]; }
+  Box const& Back() const
+  {
+    return boxes_[(head_ + size_ - 1) % boxes_.size()];
+  }
+
+ private:
+  std::vector<Box> boxes_;
+  int head_;
+  int size_;
+};
+
+// State shared by the tracks of one TrackManager: settings, label counter and
+// filter store. Only the thread running that manager touches it; managers run
+// in parallel hand out labels from disjoint sequences offset + k * stride.
+class TrackContext
+{
+ public:
+  TrackContext(yc::ConfParam const& conf_param = yc::ConfParam(),
+      double fps = 0, int label_offset = 0, int label_stride = 1)
+      : conf_param_(conf_param),
+        fps_(fps),
+        next_label_(label_offset),
+        label_stride_(max_val_cmp(label_stride, 1)),
+        next_id_(0)
+  {
+  }
+
+  int NextLabel()
+  {
+    int label = next_label_;
+    next_label_ += label_stride_;
+    return label;
+  }
+
+  int NextId() { return next_id_++; }
+
+ public:
+  yc::ConfParam conf_param_;
+  double fps_;
+  int next_label_;
+  int label_stride_;
+  int next_id_;
+
+  KalmanStore kf_store_;
+};
+
 class Track::TrackImpl
 {
  public:
   TrackImpl();
-  TrackImpl(MostProbDet const& det);
+  TrackImpl(MostProbDet const& det, TrackContext* ctx = nullptr);
+  ~TrackImpl();
 
   void Predict();
   void Correct(MostProbDet const& det);
-  void InitKalmanFilter(cv::Point2f const& point);
+  void CopyFrom(TrackImpl const& other);
+
+  // bookkeeping after the filter of a MOVING track ran
+  void Predicted();
+  void Corrected(MostProbDet const& det);
+  void Propagated();
 
  public:
-  static yc::ConfParam conf_param_;
-  static double fps_;
-  static int shared_label_;
+  // the manager's context, or one owned by a lone or copied track
+  TrackContext* ctx_;
+  bool own_ctx_;
+  int slot_;  // in ctx_->kf_store_
 
   TRACK_STATUS status_;
-  std::deque<Box> pt_history_;
-
-  cv::KalmanFilter kf_;
+  BoxRing pt_history_;
 
   int count_;
 
+  int id_;
   int label_;
   int conf_;
 
@@ -40,53 +120,94 @@ class Track::TrackImpl
   MostProbDet det_;
 };
 
-yc::ConfParam Track::TrackImpl::conf_param_;
-double Track::TrackImpl::fps_ = 0;
-int Track::TrackImpl::shared_label_ = 0;
-
-Track::TrackImpl::TrackImpl() {}
-Track::TrackImpl::TrackImpl(MostProbDet const& det)
-    : status_(MOVING),
+Track::TrackImpl::TrackImpl()
+    : ctx_(nullptr), own_ctx_(false), slot_(-1), id_(-1)
+{
+}
+Track::TrackImpl::TrackImpl(MostProbDet const& det, TrackContext* ctx)
+    : ctx_(ctx),
+      own_ctx_(ctx == nullptr),
+      status_(MOVING),
       count_(1),
       label_(-1),
-      conf_(conf_param_.init_conf_),
       enter_status_(false),
       exit_status_(false),
       det_(det)
 {
-  InitKalmanFilter(cv::Point2f(det.bbox.x, det.bbox.y));
+  if (own_ctx_)
+    ctx_ = new TrackContext;
+
+  id_ = ctx_->NextId();
+  slot_ = ctx_->kf_store_.Add(det.bbox.x, det.bbox.y);
+  pt_history_ = BoxRing((int)(ctx_->fps_ * 10));
+  conf_ = ctx_->conf_param_.init_conf_;
+}
+
+Track::TrackImpl::~TrackImpl()
+{
+  if (own_ctx_)
+    delete ctx_;
 }
 
 void Track::TrackImpl::Predict()
+{
+  if (status_ == MOVING && slot_ >= 0)
+    ctx_->kf_store_.Predict(slot_);
+  Predicted();
+}
+
+void Track::TrackImpl::Predicted()
 {
   if (status_ == MOVING)
   {
-    cv::Mat result = kf_.predict();
-    det_.bbox.x = result.at<float>(0);
-    det_.bbox.y = result.at<float>(1);
+    if (slot_ >= 0)
+    {
+      det_.bbox.x = ctx_->kf_store_.x[slot_];
+      det_.bbox.y = ctx_->kf_store_.y[slot_];
+    }
     conf_--;
   }
 
   count_++;
-  if (count_ >= conf_param_.min_conf_ && label_ < 0)
-    label_ = shared_label_++;
+  if (count_ >= ctx_->conf_param_.min_conf_ && label_ < 0)
+    label_ = ctx_->NextLabel();
+}
+
+// frame without detections: the box moves but confidence is left alone
+void Track::TrackImpl::Propagated()
+{
+  if (status_ == MOVING && slot_ >= 0)
+  {
+    det_.bbox.x = ctx_->kf_store_.x[slot_];
+    det_.bbox.y = ctx_->kf_store_.y[slot_];
+  }
+
+  count_++;
 }
 
 void Track::TrackImpl::Correct(MostProbDet const& det)
+{
+  if (status_ == MOVING && slot_ >= 0)
+    ctx_->kf_store_.Correct(slot_, det.bbox.x, det.bbox.y);
+  Corrected(det);
+}
+
+void Track::TrackImpl::Corrected(MostProbDet const& det)
 {
   Box const& bbox = det.bbox;
 
   if (status_ == MOVING)
   {
-    cv::Mat result = kf_.correct((cv::Mat_<float>(2, 1) << bbox.x, bbox.y));
-
-    det_.bbox.x = result.at<float>(0);
-    det_.bbox.y = result.at<float>(1);
+    if (slot_ >= 0)
+    {
+      det_.bbox.x = ctx_->kf_store_.x[slot_];
+      det_.bbox.y = ctx_->kf_store_.y[slot_];
+    }
     det_.bbox.w = (det_.bbox.w + bbox.w) / 2;
     det_.bbox.h = (det_.bbox.h + bbox.h) / 2;
     det_.prob = (det_.prob + det.prob) / 2;
 
-    conf_ = min_val_cmp(conf_param_.max_conf_, conf_ + 2);
+    conf_ = min_val_cmp(ctx_->conf_param_.max_conf_, conf_ + 2);
   }
   else
   {
@@ -97,53 +218,59 @@ void Track::TrackImpl::Correct(MostProbDet const& det)
   }
 
   // status change
-  pt_history_.push_back(det_.bbox);
-  if (pt_history_.size() > fps_ * 10)
-    pt_history_.pop_front();
-
-  if (pt_history_.size() < fps_)
+  pt_history_.Push(det_.bbox);
+  if (pt_history_.Size() < ctx_->fps_)
     return;
 
-  Box bbox1 = pt_history_.front();
-  Box bbox2 = pt_history_.back();
+  Box bbox1 = pt_history_.Front();
+  Box bbox2 = pt_history_.Back();
   if (Box::Iou(bbox1, bbox2) > 0.7 && det_.prob > 0.9)
     status_ = STATIONARY;
   else
     status_ = MOVING;
 }
 
-void Track::TrackImpl::InitKalmanFilter(cv::Point2f const& point)
+// copies get a context and filter of their own
+void Track::TrackImpl::CopyFrom(TrackImpl const& other)
 {
-  kf_.init(4, 2);
-  kf_.transitionMatrix =
-      (cv::Mat_<float>(4, 4) << 1, 0, 1, 0, 0, 1, 0, 1, 0, 0, 1, 0, 0, 0, 0, 1);
+  TrackContext const* src = other.ctx_;
+  TrackContext* ctx = new TrackContext(src->conf_param_, src->fps_,
+      src->next_label_, src->label_stride_);
+  slot_ = -1;
+  if (other.slot_ >= 0)
+    slot_ = ctx->kf_store_.Add(src->kf_store_, other.slot_);
+
+  if (own_ctx_)
+    delete ctx_;
+  ctx_ = ctx;
+  own_ctx_ = true;
+
+  status_ = other.status_;
+  pt_history_ = other.pt_history_;
+
+  count_ = other.count_;
 
-  setIdentity(kf_.measurementMatrix);
-  setIdentity(kf_.processNoiseCov, cv::Scalar::all(1e-4f));
-  setIdentity(kf_.measurementNoiseCov, cv::Scalar::all(2e-4f));
-  kf_.statePost = (cv::Mat_<float>(4, 1) << point.x, point.y, 0.0f, 0.0f);
+  id_ = other.id_;
+  label_ = other.label_;
+  conf_ = other.conf_;
+
+  enter_status_ = other.enter_status_;
+  exit_status_ = other.exit_status_;
+
+  det_ = other.det_;
 }
 ///
 
 ///
 Track::Track(MostProbDet const& det) : impl_(new TrackImpl(det)) {}
+Track::Track(MostProbDet const& det, TrackContext* ctx)
+    : impl_(new TrackImpl(det, ctx))
+{
+}
 
 Track::Track(Track const& other) : impl_(new TrackImpl)
 {
-  impl_->status_ = other.impl_->status_;
-  impl_->pt_history_ = other.impl_->pt_history_;
-
-  impl_->kf_ = other.impl_->kf_;
-
-  impl_->count_ = other.impl_->count_;
-
-  impl_->label_ = other.impl_->label_;
-  impl_->conf_ = other.impl_->conf_;
-
-  impl_->enter_status_ = other.impl_->enter_status_;
-  impl_->exit_status_ = other.impl_->exit_status_;
-
-  impl_->det_ = other.impl_->det_;
+  impl_->CopyFrom(*other.impl_);
 }
 
 Track::~Track() { delete impl_; }
@@ -151,22 +278,7 @@ Track::~Track() { delete impl_; }
 Track& Track::operator=(Track const& other)
 {
   if (this != &other)
-  {
-    impl_->status_ = other.impl_->status_;
-    impl_->pt_history_ = other.impl_->pt_history_;
-
-    impl_->kf_ = other.impl_->kf_;
-
-    impl_->count_ = other.impl_->count_;
-
-    impl_->label_ = other.impl_->label_;
-    impl_->conf_ = other.impl_->conf_;
-
-    impl_->enter_status_ = other.impl_->enter_status_;
-    impl_->exit_status_ = other.impl_->exit_status_;
-
-    impl_->det_ = other.impl_->det_;
-  }
+    impl_->CopyFrom(*other.impl_);
 
   return *this;
 }
@@ -178,6 +290,7 @@ void Track::SetEnterStatus(bool status) { impl_->enter_status_ = status; }
 void Track::SetExitStatus(bool status) { impl_->exit_status_ = status; }
 
 int Track::GetCount() const { return impl_->count_; }
+int Track::GetId() const { return impl_->id_; }
 int Track::GetLabel() const { return impl_->label_; }
 int Track::GetConfidence() const { return impl_->conf_; }
 bool Track::GetEnterStatus() const { return impl_->enter_status_; }
@@ -190,123 +303,336 @@ float Track::GetClassProb() const { return impl_->det_.prob; }
 void Track::Predict() { impl_->Predict(); }
 void Track::Correct(MostProbDet const& det) { impl_->Correct(det); }
 
-void Track::SetConfParam(yc::ConfParam const& conf_param)
-{
-  TrackImpl::conf_param_ = conf_param;
-}
-void Track::SetFps(double fps) { TrackImpl::fps_ = fps; }
-double Track::GetFps() { return TrackImpl::fps_; }
+double Track::GetFps() const { return impl_->ctx_->fps_; }
 ///
 
 ///
+namespace
+{
+// Track-detection pair whose IoU passes the association threshold
+typedef struct SimEdge
+{
+  int track;
+  int det;
+  float iou;
+} SimEdge;
+
+// Uniform grid over the predicted track boxes. A box is listed in every cell
+// it overlaps, so any box overlapping it shares at least one cell with it.
+class TrackGrid
+{
+ public:
+  TrackGrid(std::vector<Box> const& boxes) : stamp_(0)
+  {
+    float right = -FLT_MAX, bottom = -FLT_MAX;
+    float mean_w = 0, mean_h = 0;
+    left_ = FLT_MAX;
+    top_ = FLT_MAX;
+    for (size_t i = 0; i < boxes.size(); i++)
+    {
+      left_ = std::min(left_, boxes[i].x - boxes[i].w / 2);
+      top_ = std::min(top_, boxes[i].y - boxes[i].h / 2);
+      right = std::max(right, boxes[i].x + boxes[i].w / 2);
+      bottom = std::max(bottom, boxes[i].y + boxes[i].h / 2);
+      mean_w += boxes[i].w;
+      mean_h += boxes[i].h;
+    }
+
+    // cells about the size of an average track, at most kMaxCells per side
+    int const kMaxCells = 64;
+    mean_w = std::max(mean_w / boxes.size(), FLT_EPSILON);
+    mean_h = std::max(mean_h / boxes.size(), FLT_EPSILON);
+    cols_ = std::max(1, std::min(kMaxCells, (int)((right - left_) / mean_w)));
+    rows_ = std::max(1, std::min(kMaxCells, (int)((bottom - top_) / mean_h)));
+    cell_w_ = std::max((right - left_) / cols_, FLT_EPSILON);
+    cell_h_ = std::max((bottom - top_) / rows_, FLT_EPSILON);
+
+    // bucket the tracks by cell, counting first
+    cell_start_.assign(cols_ * rows_ + 1, 0);
+    for (int pass = 0; pass < 2; pass++)
+    {
+      std::vector<int> fill(cell_start_.begin(), cell_start_.end() - 1);
+      for (int i = 0; i < (int)boxes.size(); i++)
+      {
+        int x0, y0, x1, y1;
+        CellRange(boxes[i], x0, y0, x1, y1);
+        for (int y = y0; y <= y1; y++)
+        {
+          for (int x = x0; x <= x1; x++)
+          {
+            if (pass == 0)
+              cell_start_[y * cols_ + x + 1]++;
+            else
+              items_[fill[y * cols_ + x]++] = i;
+          }
+        }
+      }
+
+      if (pass == 0)
+      {
+        for (int c = 0; c < cols_ * rows_; c++)
+        {
+          cell_start_[c + 1] += cell_start_[c];
+        }
+        items_.resize(cell_start_.back());
+      }
+    }
+    seen_.assign(boxes.size(), -1);
+  }
+
+  // Tracks sharing a cell with b, each reported once
+  void Query(Box const& b, std::vector<int>& cands)
+  {
+    cands.clear();
+    stamp_++;
+
+    int x0, y0, x1, y1;
+    if (!CellRange(b, x0, y0, x1, y1))
+      return;
+
+    for (int y = y0; y <= y1; y++)
+    {
+      for (int x = x0; x <= x1; x++)
+      {
+        int c = y * cols_ + x;
+        for (int k = cell_start_[c]; k < cell_start_[c + 1]; k++)
+        {
+          if (seen_[items_[k]] == stamp_)
+            continue;
+
+          seen_[items_[k]] = stamp_;
+          cands.push_back(items_[k]);
+        }
+      }
+    }
+  }
+
+ private:
+  // Clamped cell range covered by b; false if b lies outside the grid
+  bool CellRange(Box const& b, int& x0, int& y0, int& x1, int& y1) const
+  {
+    float l = (b.x - b.w / 2 - left_) / cell_w_;
+    float t = (b.y - b.h / 2 - top_) / cell_h_;
+    float r = (b.x + b.w / 2 - left_) / cell_w_;
+    float d = (b.y + b.h / 2 - top_) / cell_h_;
+    if (r < 0 || d < 0 || l >= cols_ || t >= rows_)
+      return false;
+
+    x0 = (int)std::max(0.0f, l);
+    y0 = (int)std::max(0.0f, t);
+    x1 = (int)std::min(cols_ - 1.0f, r);
+    y1 = (int)std::min(rows_ - 1.0f, d);
+    return true;
+  }
+
+ private:
+  float left_, top_;
+  float cell_w_, cell_h_;
+  int cols_, rows_;
+
+  std::vector<int> cell_start_;
+  std::vector<int> items_;
+
+  std::vector<int> seen_;
+  int stamp_;
+};
+
+int FindRoot(std::vector<int>& parent, int i)
+{
+  while (parent[i] != i)
+  {
+    parent[i] = parent[parent[i]];
+    i = parent[i];
+  }
+  return i;
+}
+}  // namespace
+
 class TrackManager::TrackManagerImpl
 {
  public:
-  TrackManagerImpl();
-  TrackManagerImpl(
-      yc::ConfParam const& conf_param, double fps, double dist_thresh);
+  TrackManagerImpl(yc::ConfParam const& conf_param, double fps,
+      double iou_thresh, int label_offset, int label_stride);
 
   void Clear();
   void Track(std::vector<MostProbDet> const& dets);
+  void Propagate();
 
   void GetTracks(std::vector<yc::Track*>& tracks);
   void GetSavedTracks(std::vector<yc::Track*>& tracks);
+  void SaveTrack(yc::Track* track);
+
+  void PredictFilters();
+  float MaxSpeed() const;
 
-  cv::Mat Associate(std::vector<MostProbDet> const& dets);
-  bool ConstructSimMat(Matrix& sim_mat, std::vector<MostProbDet> const& dets);
+  std::vector<int> Associate(std::vector<MostProbDet> const& dets);
+  void ConstructSimGraph(
+      std::vector<SimEdge>& edges, std::vector<MostProbDet> const& dets);
 
  public:
-  yc::ConfParam conf_param_;
+  TrackContext ctx_;
   double iou_thresh_;
 
   std::vector<yc::Track*> tracks_;
-  std::vector<yc::Track*> saved_tracks_;
-};
 
-TrackManager::TrackManagerImpl::TrackManagerImpl() {}
+  // the latest finished tracks, older ones only live in the log
+  std::deque<yc::Track*> saved_tracks_;
+  int max_saved_tracks_;
+  TrackLogWriter log_;
+
+  int64_t frame_;
+  TrackStats stats_;
+};
 
 TrackManager::TrackManagerImpl::TrackManagerImpl(
-    yc::ConfParam const& conf_param, double fps, double iou_thresh)
-    : conf_param_(conf_param), iou_thresh_(iou_thresh)
+    yc::ConfParam const& conf_param, double fps, double iou_thresh,
+    int label_offset, int label_stride)
+    : ctx_(conf_param, fps, label_offset, label_stride),
+      iou_thresh_(iou_thresh),
+      max_saved_tracks_(1024),
+      frame_(0),
+      stats_(TrackStats())
 {
-  Track::SetConfParam(conf_param);
-  Track::SetFps(fps);
 }
 
 void TrackManager::TrackManagerImpl::Clear()
 {
+  for (size_t i = 0; i < tracks_.size(); i++)
+  {
+    tracks_[i]->impl_->slot_ = -1;
+  }
+  ctx_.kf_store_.Clear();
+
   tracks_.clear();
   tracks_.shrink_to_fit();
 }
 
+// filters of the MOVING tracks in one batch
+void TrackManager::TrackManagerImpl::PredictFilters()
+{
+  int num_tracks = (int)tracks_.size();
+  std::vector<char> mask(num_tracks);
+  for (int i = 0; i < num_tracks; i++)
+  {
+    mask[i] = tracks_[i]->GetStatus() == MOVING;
+  }
+
+  ctx_.kf_store_.Predict(mask.data());
+}
+
+float TrackManager::TrackManagerImpl::MaxSpeed() const
+{
+  KalmanStore const& kf = ctx_.kf_store_;
+  float max_speed = 0;
+  for (size_t i = 0; i < tracks_.size(); i++)
+  {
+    Box b = tracks_[i]->GetBox();
+    if (tracks_[i]->GetStatus() != MOVING || b.w <= 0 || b.h <= 0)
+      continue;
+
+    max_speed = max_val_cmp(max_speed, fabs(kf.vx[i]) / b.w);
+    max_speed = max_val_cmp(max_speed, fabs(kf.vy[i]) / b.h);
+  }
+
+  return max_speed;
+}
+
 void TrackManager::TrackManagerImpl::Track(std::vector<MostProbDet> const& dets)
 {
+  frame_++;
+  stats_ = TrackStats();
+  stats_.num_tracks = (int)tracks_.size();
+  stats_.num_dets = (int)dets.size();
+  stats_.mean_iou = 1.0f;
+
   if (tracks_.size() != 0)
   {
     // predict existing tracks
-    for (size_t i = 0; i < tracks_.size(); i++)
+    int num_tracks = (int)tracks_.size();
+    PredictFilters();
+    for (int i = 0; i < num_tracks; i++)
     {
-      tracks_[i]->Predict();
+      tracks_[i]->impl_->Predicted();
     }
 
     if (dets.size() != 0)
     {
-      cv::Mat table = Associate(dets);
+      std::vector<int> match = Associate(dets);
+      std::vector<char> matched(dets.size(), 0);
 
       // correct existing tracks
-      for (int i = 0; i < (int)tracks_.size(); i++)
+      std::vector<char> mask(num_tracks);
+      std::vector<float> zx(num_tracks), zy(num_tracks);
+      float sum_iou = 0;
+      for (int i = 0; i < num_tracks; i++)
       {
-        for (int j = 0; j < (int)dets.size(); j++)
+        mask[i] = match[i] >= 0 && tracks_[i]->GetStatus() == MOVING;
+        if (mask[i])
         {
-          if (!table.at<int>(i, j))
-            continue;
+          zx[i] = dets[match[i]].bbox.x;
+          zy[i] = dets[match[i]].bbox.y;
+        }
 
-          tracks_[i]->Correct(dets[j]);
+        if (match[i] >= 0)
+        {
+          sum_iou += Box::Iou(tracks_[i]->GetBox(), dets[match[i]].bbox);
+          stats_.num_matched++;
         }
       }
 
-      table = table.t();  // transpose matrix to improve performance
-      int num_tracks = (int)tracks_.size();
+      if (stats_.num_matched > 0)
+        stats_.mean_iou = sum_iou / stats_.num_matched;
+
+      ctx_.kf_store_.Correct(mask.data(), zx.data(), zy.data());
+      for (int i = 0; i < num_tracks; i++)
+      {
+        if (match[i] < 0)
+          continue;
+
+        tracks_[i]->impl_->Corrected(dets[match[i]]);
+        matched[match[i]] = 1;
+      }
 
       // launch new tracks
       for (int i = 0; i < (int)dets.size(); i++)
       {
-        int sum = 0;
-        for (int j = 0; j < num_tracks; j++)
-        {
-          sum += table.at<int>(i, j);
-        }
-
-        if (!sum)
-          tracks_.push_back(new yc::Track(dets[i]));
+        if (!matched[i])
+          tracks_.push_back(new yc::Track(dets[i], &ctx_));
       }
+      stats_.num_new = (int)dets.size() - stats_.num_matched;
     }
   }
   else
   {
+    stats_.num_new = (int)dets.size();
+
     // launch new tracks
     for (int i = 0; i < (int)dets.size(); i++)
     {
-      tracks_.push_back(new yc::Track(dets[i]));
+      tracks_.push_back(new yc::Track(dets[i], &ctx_));
     }
   }
 
-  // delete tracks
+  // delete tracks, saved ones leave the filter store
   std::vector<yc::Track*> remaining_tracks;
   std::vector<yc::Track*> dumped_tracks;
+  std::vector<int> keep;
 
   for (size_t i = 0; i < tracks_.size(); i++)
   {
     if (tracks_[i]->GetConfidence() > 0)
     {
       remaining_tracks.push_back(tracks_[i]);
+      keep.push_back((int)i);
     }
     else
     {
       if (tracks_[i]->GetCount() > 30)
-        saved_tracks_.push_back(tracks_[i]);
+        SaveTrack(tracks_[i]);
       else
+      {
         dumped_tracks.push_back(tracks_[i]);
+      }
     }
   }
 
@@ -315,7 +641,28 @@ void TrackManager::TrackManagerImpl::Track(std::vector<MostProbDet> const& dets)
     delete dumped_tracks[i];
   }
 
+  stats_.num_lost = (int)(tracks_.size() - remaining_tracks.size());
   tracks_ = remaining_tracks;
+  log_.Flush();
+
+  // slot i of the store always belongs to tracks_[i]
+  ctx_.kf_store_.Compact(keep);
+  for (size_t i = 0; i < tracks_.size(); i++)
+  {
+    tracks_[i]->impl_->slot_ = (int)i;
+  }
+
+  stats_.max_speed = MaxSpeed();
+}
+
+void TrackManager::TrackManagerImpl::Propagate()
+{
+  frame_++;
+  PredictFilters();
+  for (size_t i = 0; i < tracks_.size(); i++)
+  {
+    tracks_[i]->impl_->Propagated();
+  }
 }
 
 void TrackManager::TrackManagerImpl::GetTracks(std::vector<yc::Track*>& tracks)
@@ -323,7 +670,7 @@ void TrackManager::TrackManagerImpl::GetTracks(std::vector<yc::Track*>& tracks)
   tracks.clear();
   for (size_t i = 0; i < tracks_.size(); i++)
   {
-    if (tracks_[i]->GetConfidence() >= conf_param_.min_conf_)
+    if (tracks_[i]->GetConfidence() >= ctx_.conf_param_.min_conf_)
       tracks.push_back(tracks_[i]);
   }
 }
@@ -331,137 +678,177 @@ void TrackManager::TrackManagerImpl::GetTracks(std::vector<yc::Track*>& tracks)
 void TrackManager::TrackManagerImpl::GetSavedTracks(
     std::vector<yc::Track*>& tracks)
 {
-  tracks = saved_tracks_;
+  tracks.assign(saved_tracks_.begin(), saved_tracks_.end());
 }
 
-cv::Mat TrackManager::TrackManagerImpl::Associate(
-    std::vector<MostProbDet> const& dets)
+// Logs a finished track and keeps it in memory until max_saved_tracks_ newer
+// ones follow; the track leaves the filter store
+void TrackManager::TrackManagerImpl::SaveTrack(yc::Track* track)
 {
-  Matrix sim_mat;
-  bool is_trans = ConstructSimMat(sim_mat, dets);
-
-  BipartiteGraph bg(sim_mat);
-  Hungarian kuhn_munkres(bg);
-  kuhn_munkres.HungarianAlgo();
+  track->impl_->slot_ = -1;
+  log_.Append(MakeTrackRecord(track, frame_ - 1));
 
-  cv::Mat match;
-  BipartiteGraph* bg_result = kuhn_munkres.GetBG();
-  if (is_trans)
-    match = cv::Mat::zeros((int)bg_result->GetNumTasks(),
-        (int)bg_result->GetNumAgents(), CV_32SC1);
-  else
-    match = cv::Mat::zeros((int)bg_result->GetNumAgents(),
-        (int)bg_result->GetNumTasks(), CV_32SC1);
-
-  for (int i = 0; i < match.rows; i++)
+  saved_tracks_.push_back(track);
+  while ((int)saved_tracks_.size() > max_saved_tracks_)
   {
-    for (int j = 0; j < match.cols; j++)
-    {
-      Edge* edge = nullptr;
-      if (is_trans)
-        edge = bg_result->GetMatrix(j, i);
-      else
-        edge = bg_result->GetMatrix(i, j);
-
-      if (edge->GetMatchedFlag() && edge->GetWeight() > iou_thresh_)
-        match.at<int>(i, j) = 1;
-    }
+    delete saved_tracks_.front();
+    saved_tracks_.pop_front();
   }
-
-  return match;
 }
 
-bool TrackManager::TrackManagerImpl::ConstructSimMat(
-    Matrix& sim_mat, std::vector<MostProbDet> const& dets)
+// Returns the detection matched to each track, or -1. Only pairs passing
+// iou_thresh_ are scored; the resulting graph is split into connected
+// components, each solved on its own.
+std::vector<int> TrackManager::TrackManagerImpl::Associate(
+    std::vector<MostProbDet> const& dets)
 {
-  bool is_trans = false;
-  if (tracks_.size() > dets.size())
-    is_trans = true;
+  int const num_tracks = (int)tracks_.size();
+  int const num_dets = (int)dets.size();
+  std::vector<int> match(num_tracks, -1);
+
+  std::vector<SimEdge> edges;
+  ConstructSimGraph(edges, dets);
+  if (edges.empty())
+    return match;
+
+  // nodes [0, num_tracks) are tracks and the rest detections
+  std::vector<int> parent(num_tracks + num_dets);
+  for (size_t i = 0; i < parent.size(); i++)
+  {
+    parent[i] = (int)i;
+  }
 
-  std::vector<Box> agents;
+  for (size_t i = 0; i < edges.size(); i++)
+  {
+    int a = FindRoot(parent, edges[i].track);
+    int b = FindRoot(parent, num_tracks + edges[i].det);
+    parent[b] = a;
+  }
 
-  if (is_trans)
+  std::vector<std::pair<int, int>> order(edges.size());
+  for (size_t i = 0; i < edges.size(); i++)
   {
-    for (size_t i = 0; i < dets.size(); i++)
-    {
-      agents.push_back(dets[i].bbox);
-    }
+    order[i] = std::make_pair(FindRoot(parent, edges[i].track), (int)i);
   }
-  else
+  std::sort(order.begin(), order.end());
+
+  std::vector<int> local(num_tracks + num_dets, -1);
+  std::vector<int> comp_tracks, comp_dets;
+  std::vector<float> cost;
+  for (size_t begin = 0, end = 0; begin < order.size(); begin = end)
   {
-    for (size_t i = 0; i < tracks_.size(); i++)
+    end = begin + 1;
+    while (end < order.size() && order[end].first == order[begin].first)
     {
-      agents.push_back(tracks_[i]->GetBox());
+      end++;
     }
-  }
 
-  std::vector<Box> tasks;
+    // unambiguous one-to-one component
+    if (end - begin == 1)
+    {
+      SimEdge const& e = edges[order[begin].second];
+      match[e.track] = e.det;
+      continue;
+    }
 
-  if (is_trans)
-  {
-    for (size_t i = 0; i < tracks_.size(); i++)
+    comp_tracks.clear();
+    comp_dets.clear();
+    for (size_t k = begin; k < end; k++)
     {
-      tasks.push_back(tracks_[i]->GetBox());
+      SimEdge const& e = edges[order[k].second];
+      if (local[e.track] < 0)
+      {
+        local[e.track] = (int)comp_tracks.size();
+        comp_tracks.push_back(e.track);
+      }
+      if (local[num_tracks + e.det] < 0)
+      {
+        local[num_tracks + e.det] = (int)comp_dets.size();
+        comp_dets.push_back(e.det);
+      }
     }
-  }
-  else
-  {
-    for (size_t i = 0; i < dets.size(); i++)
+
+    // maximize the total IoU, pairs without an edge gain nothing
+    int const rows = (int)comp_tracks.size();
+    int const cols = (int)comp_dets.size();
+    cost.assign((size_t)rows * cols, 0.0f);
+    for (size_t k = begin; k < end; k++)
     {
-      tasks.push_back(dets[i].bbox);
+      SimEdge const& e = edges[order[k].second];
+      cost[(size_t)local[e.track] * cols + local[num_tracks + e.det]] = -e.iou;
     }
-  }
 
-  // Allocate matrix
-  sim_mat.resize(agents.size());
-  for (size_t i = 0; i < sim_mat.size(); i++)
-  {
-    sim_mat[i].resize(tasks.size());
-  }
+    std::vector<int> sol = SolveAssignment(cost.data(), rows, cols);
+    for (int i = 0; i < rows; i++)
+    {
+      if (sol[i] >= 0 && cost[(size_t)i * cols + sol[i]] < 0)
+        match[comp_tracks[i]] = comp_dets[sol[i]];
+    }
 
-  for (size_t i = 0; i < agents.size(); i++)
-  {
-    for (size_t j = 0; j < tasks.size(); j++)
+    for (int i = 0; i < rows; i++)
     {
-      sim_mat[i][j].SetWeight(Box::Iou(agents[i], tasks[j]));
+      local[comp_tracks[i]] = -1;
+    }
+    for (int j = 0; j < cols; j++)
+    {
+      local[num_tracks + comp_dets[j]] = -1;
     }
   }
 
-  return is_trans;
-};
-
-TrackManager::TrackManager(
-    yc::ConfParam const& conf_param, double fps, double iou_thresh)
-    : impl_(new TrackManagerImpl(conf_param, fps, iou_thresh))
-{
+  return match;
 }
 
-TrackManager::TrackManager(TrackManager const& other)
-    : impl_(new TrackManagerImpl)
+// Scores only the track-detection pairs found near each other on a grid over
+// the predicted track boxes; the candidates of a detection are gathered in a
+// BoxBatch and scored by the batched IoU kernel
+void TrackManager::TrackManagerImpl::ConstructSimGraph(
+    std::vector<SimEdge>& edges, std::vector<MostProbDet> const& dets)
 {
-  impl_->conf_param_ = other.impl_->conf_param_;
-  impl_->iou_thresh_ = other.impl_->iou_thresh_;
-
-  impl_->tracks_ = other.impl_->tracks_;
-  impl_->saved_tracks_ = other.impl_->saved_tracks_;
-}
-
-TrackManager::~TrackManager() { delete impl_; }
+  std::vector<Box> track_boxes(tracks_.size());
+  for (size_t i = 0; i < tracks_.size(); i++)
+  {
+    track_boxes[i] = tracks_[i]->GetBox();
+  }
 
-TrackManager& TrackManager::operator=(TrackManager const& other)
-{
-  if (this != &other)
+  TrackGrid grid(track_boxes);
+  std::vector<int> cands;
+  BoxBatch cand_boxes;
+  std::vector<float> ious;
+  for (int j = 0; j < (int)dets.size(); j++)
   {
-    impl_->conf_param_ = other.impl_->conf_param_;
-    impl_->iou_thresh_ = other.impl_->iou_thresh_;
+    grid.Query(dets[j].bbox, cands);
+    if (cands.empty())
+      continue;
 
-    impl_->tracks_ = other.impl_->tracks_;
-    impl_->saved_tracks_ = other.impl_->saved_tracks_;
+    cand_boxes.Clear();
+    for (size_t k = 0; k < cands.size(); k++)
+    {
+      cand_boxes.Push(track_boxes[cands[k]]);
+    }
+    ious.resize(cands.size());
+    cand_boxes.Iou(dets[j].bbox, 0, (int)cands.size(), ious.data());
+
+    for (size_t k = 0; k < cands.size(); k++)
+    {
+      float iou = ious[k];
+      if (iou > iou_thresh_ && iou > 0)
+      {
+        SimEdge e = {cands[k], j, iou};
+        edges.push_back(e);
+      }
+    }
   }
+}
 
-  return *this;
+TrackManager::TrackManager(yc::ConfParam const& conf_param, double fps,
+    double iou_thresh, int label_offset, int label_stride)
+    : impl_(new TrackManagerImpl(
+          conf_param, fps, iou_thresh, label_offset, label_stride))
+{
 }
 
+TrackManager::~TrackManager() { delete impl_; }
+
 void TrackManager::Clear() { impl_->Clear(); }
 void TrackManager::Track(std::vector<MostProbDet> const& dets)
 {
@@ -476,4 +863,35 @@ void TrackManager::GetSavedTracks(std::vector<yc::Track*>& tracks)
 {
   impl_->GetSavedTracks(tracks);
 }
+
+void TrackManager::Propagate() { impl_->Propagate(); }
+
+void TrackManager::SetSavedTrackLimit(int max_saved_tracks)
+{
+  impl_->max_saved_tracks_ = max_val_cmp(max_saved_tracks, 0);
+  while ((int)impl_->saved_tracks_.size() > impl_->max_saved_tracks_)
+  {
+    delete impl_->saved_tracks_.front();
+    impl_->saved_tracks_.pop_front();
+  }
+}
+
+bool TrackManager::OpenTrackLog(std::string const& path)
+{
+  return impl_->log_.Open(path);
+}
+TrackStats TrackManager::GetStats() const { return impl_->stats_; }
+
+// Managers share no state, so each camera is tracked on its own thread
+void TrackCameras(std::vector<TrackManager*> const& managers,
+    std::vector<std::vector<MostProbDet>> const& dets)
+{
+  int const num_cams = (int)managers.size();
+
+#pragma omp parallel for schedule(dynamic, 1)
+  for (int i = 0; i < num_cams; i++)
+  {
+    managers[i]->Track(dets[i]);
+  }
+}
 }  // namespace yc
\ No newline at end of file
@@ -6,6 +6,8 @@
 
 namespace yc
 {
+class TrackContext;
+
 class LIB_API ConfParam
 {
  public:
@@ -21,6 +23,18 @@ class LIB_API ConfParam
   int max_conf_;
 };
 
+// Outcome of the last TrackManager::Track() call
+struct TrackStats
+{
+  int num_tracks;   // before association
+  int num_dets;
+  int num_matched;
+  int num_new;
+  int num_lost;     // tracks ended by this frame
+  float mean_iou;   // predicted track box vs. matched detection, 1 if none
+  float max_speed;  // per-frame motion of MOVING tracks in box sizes
+};
+
 enum TRACK_STATUS
 {
   MOVING,
@@ -43,6 +57,8 @@ class LIB_API Track
   void SetExitStatus(bool status);
 
   int GetCount() const;
+  // unique among the tracks of a manager, unlike addresses of deleted tracks
+  int GetId() const;
   int GetLabel() const;
   int GetConfidence() const;
   bool GetEnterStatus() const;
@@ -52,15 +68,15 @@ class LIB_API Track
   int GetClassId() const;
   float GetClassProb() const;
 
+  double GetFps() const;
+
   void Predict();
   void Correct(MostProbDet const& det);
 
- public:
-  static void SetConfParam(yc::ConfParam const& conf_param);
-  static void SetFps(double fps);
-  static double GetFps();
-
  private:
+  friend class TrackManager;
+  Track(MostProbDet const& det, TrackContext* ctx);
+
   class TrackImpl;
   TrackImpl* impl_;
 };
@@ -68,20 +84,40 @@ class LIB_API Track
 class LIB_API TrackManager
 {
  public:
-  TrackManager(yc::ConfParam const& conf_param, double fps, double iou_thresh);
-  TrackManager(TrackManager const& other);
+  // Labels are label_offset + k * label_stride, so managers given distinct
+  // offsets below a common stride never hand out the same label
+  TrackManager(yc::ConfParam const& conf_param, double fps, double iou_thresh,
+      int label_offset = 0, int label_stride = 1);
   ~TrackManager();
 
-  TrackManager& operator=(TrackManager const& other);
+  // tracks are bound to the filter slots of their manager's context and
+  // cannot move to another one
+  TrackManager(TrackManager const& other) = delete;
+  TrackManager& operator=(TrackManager const& other) = delete;
 
   void Clear();
   void Track(std::vector<MostProbDet> const& dets);
 
+  // Moves the tracks by their filters for a frame without detections, while
+  // their confidences stay as they are
+  void Propagate();
+
   void GetTracks(std::vector<yc::Track*>& tracks);
   void GetSavedTracks(std::vector<yc::Track*>& tracks);
+  TrackStats GetStats() const;
+
+  // Finished tracks stay in memory up to max_saved_tracks (1024 by default),
+  // the oldest being freed first; with a log open every finished track is
+  // also appended to it, see track_log.h
+  void SetSavedTrackLimit(int max_saved_tracks);
+  bool OpenTrackLog(std::string const& path);
 
  private:
   class TrackManagerImpl;
   TrackManagerImpl* impl_;
 };
+
+// Runs managers[i]->Track(dets[i]) for every camera in parallel
+LIB_API void TrackCameras(std::vector<TrackManager*> const& managers,
+    std::vector<std::vector<MostProbDet>> const& dets);
 }  // namespace yc
\ No newline at end of file
@@ -3,7 +3,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "detect_scheduler.h"
 #include "geo_info.h"
+#include "motion_gate.h"
+#include "preprocess.h"
+#include "resolution_controller.h"
+#include "spsc_queue.h"
+#include "tiling.h"
 #include "track_manager.h"
 #include "visualize.h"
 
@@ -12,6 +18,14 @@
 #endif
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <mutex>
+#include <numeric>
+#include <sstream>
+#include <thread>
 
 #ifdef GPU
 #include <cuda.h>
@@ -26,20 +40,94 @@ DEFINE_bool(show_imgs, false, "");
 DEFINE_bool(save_output, false, "Save output to image or video");
 DEFINE_bool(calc_map, true, "Calculate mAP during training");
 DEFINE_bool(disable_tracking, false, "Disable tracking while processing video");
+DEFINE_bool(fused_decode, false,
+    "Threshold yolo outputs on logits and decode boxes in a single pass");
+DEFINE_bool(letterbox, false,
+    "Fit frames into the network input keeping their aspect ratio");
+DEFINE_bool(zone_roi, false,
+    "Detect only within the box around the zones of the GeoInfo XML of each "
+    "input, letterboxed into the network input");
+DEFINE_bool(pipeline, false,
+    "Run the stages of video mode in their own threads, so decoding, "
+    "preprocessing, inference, tracking and rendering of successive frames "
+    "overlap");
 
 DEFINE_int32(benchmark_layers, 0, "Indexes of layers to be benchmarked");
 DEFINE_int32(num_gpus, 1, "Number of GPUs");
 DEFINE_int32(cuda_dbg_sync, 0, "");
+DEFINE_int32(head_mask, -1,
+    "Bit mask of enabled detection heads in cfg order; -1 enables all heads");
+DEFINE_int32(top_k_classes, 0,
+    "Keep only the top-k classes of each box in a sparse representation; "
+    "0 keeps dense class probabilities");
+DEFINE_int32(nms_bench_boxes, 20000, "Number of boxes for nms-bench mode");
+DEFINE_int32(nms_bench_classes, 80, "Number of classes for nms-bench mode");
+DEFINE_int32(motion_max_skip, 0,
+    "Frames in a row the motion gate may skip before the detector runs "
+    "anyway; 0 for no limit");
+DEFINE_int32(adaptive_hold, 15,
+    "Detector frames in a row asking for another input size before "
+    "adaptive_sizes switches to it");
+DEFINE_int32(bench_frames, 300, "Number of timed frames in bench mode");
+DEFINE_int32(bench_warmup, 20,
+    "Number of frames run before timing starts in bench mode");
+DEFINE_int32(zone_raster, 0,
+    "Resolution of the zone-ID image used to find the parking lot under a "
+    "track; 0 uses the zone grid only");
+DEFINE_int32(max_detect_interval, 1,
+    "Upper bound of the adaptive number of frames between detector runs in "
+    "video mode; tracks are propagated in between, 1 detects every frame");
 
 DEFINE_double(thresh, 0.5, "Threshold for object's confidence");
 DEFINE_double(nms_thresh, 0.45, "Threshold for non-maxima suppression");
-
-DEFINE_string(mode, "video", "Either train/valid/image/video");
+DEFINE_double(motion_thresh, 0,
+    "Mean gray-level change of an image block needed to run the detector "
+    "again in video mode; frames below it reuse the last detections, 0 "
+    "disables the motion gate");
+DEFINE_double(incremental_forward, 0,
+    "Largest changed fraction of the network input for which only the "
+    "changed areas are recomputed from the last frame on the CPU; larger "
+    "changes run a full forward pass, 0 always does");
+DEFINE_double(zone_roi_margin, 0.05,
+    "Margin added on every side of the zones by zone_roi, as a fraction of "
+    "the frame");
+DEFINE_double(latency_budget, 0,
+    "Forward pass time budget of a detector frame in ms for adaptive_sizes; "
+    "0 follows the object sizes only");
+DEFINE_double(adaptive_min_object, 16,
+    "Side in network input pixels adaptive_sizes keeps the small objects "
+    "at, if the latency budget allows");
+DEFINE_double(tile_overlap, 0.2,
+    "Fraction of a tile shared with each of its neighbours in tiled mode");
+
+DEFINE_string(
+    mode, "video", "Either train/valid/image/video/nms-bench/bench");
 DEFINE_string(data_file, "yolo.data", "Data file path");
 DEFINE_string(model_file, "yolo.cfg", "Model file path");
 DEFINE_string(weights_file, "yolo.weights", "Weights file path");
 DEFINE_string(input_file, "test.avi",
     "Input file path for image/video modes; use comma to input multiple files");
+DEFINE_string(bench_synthetic, "",
+    "Size of random frames, e.g. 1920x1080, fed to bench mode instead of "
+    "input_file");
+DEFINE_string(bench_json, "",
+    "Write the bench mode report to this file instead of stdout");
+DEFINE_string(motion_mask, "",
+    "Image whose non-zero pixels are watched by the motion gate");
+DEFINE_string(adaptive_sizes, "",
+    "Network input sizes, e.g. 320x320,416x416,608x608, among which video "
+    "mode picks the one meeting latency_budget for the object sizes seen; "
+    "empty keeps the cfg size");
+DEFINE_string(tiles, "",
+    "Detect on a grid of overlapping tiles, e.g. 3x2, each resized to the "
+    "network input, instead of on the whole frame; small objects of large "
+    "frames keep more pixels");
+DEFINE_string(tile_roi, "",
+    "Frame area covered by the tiles as x,y,w,h in pixels; empty covers the "
+    "whole frame");
+DEFINE_string(track_log, "",
+    "Append finished tracks to this binary log; multi-video mode adds the "
+    "camera index as a suffix");
 
 #ifdef GPU
 #define CUDA_ASSERT(x) CudaAssert((x), __FILE__, __LINE__)
@@ -101,39 +189,1084 @@ void SeparateInputFiles(std::vector<std::string>& files)
   }
 }
 
-void ProcImage(Metadata const& md, Network* net, cv::Mat const& input,
-    cv::Mat& resize, cv::Mat& display, Image& image,
-    yc::TrackManager* track_manager = nullptr)
+// Network input of a frame, allocated on first use and again whenever the
+// network was resized
+void PrepareImage(Network* net, cv::Mat const& input, Image& image)
 {
-  cv::resize(input, resize, cv::Size(net->w, net->h));
-  cv::resize(input, display, display.size());
-  cv::cvtColor(resize, resize, cv::COLOR_RGB2BGR);
-  Mat2Image(resize, &image);
-  NetworkPredict(net, image.data);
+  if (image.data != nullptr && (image.w != net->w || image.h != net->h))
+  {
+    delete[] image.data;
+    image.data = nullptr;
+  }
+  Mat2NetworkInput(input, net->w, net->h, &image, FLAGS_letterbox);
+}
 
-  int num_dets = 0;
-  Detection* dets = GetNetworkBoxes(net, FLAGS_thresh, &num_dets);
+// Boxes relative to the frame rather than to the letterboxed network input
+void FitDetsToFrame(
+    Network* net, cv::Mat const& input, std::vector<MostProbDet>& dets)
+{
+  if (FLAGS_letterbox)
+    CorrectLetterboxDets(dets, input.cols, input.rows, net->w, net->h);
+}
+
+// Columns and rows of --tiles; false when frames are not tiled
+bool TileGrid(int& cols, int& rows)
+{
+  cols = rows = 0;
+  return sscanf(FLAGS_tiles.c_str(), "%dx%d", &cols, &rows) == 2 &&
+         cols > 0 && rows > 0;
+}
+
+// Tiles of a frame, covering --tile_roi clipped to the frame if given
+std::vector<cv::Rect> FrameTiles(cv::Mat const& input)
+{
+  int cols, rows;
+  TileGrid(cols, rows);
+
+  cv::Rect area(0, 0, input.cols, input.rows);
+  int x, y, w, h;
+  if (sscanf(FLAGS_tile_roi.c_str(), "%d,%d,%d,%d", &x, &y, &w, &h) == 4)
+  {
+    cv::Rect roi = cv::Rect(x, y, w, h) & area;
+    if (roi.area() > 0)
+      area = roi;
+  }
+  return TileRects(area, cols, rows, (float)FLAGS_tile_overlap);
+}
+
+// Network inputs of all tiles of a frame stored back to back in image.data,
+// allocated on first use and again whenever the network was resized
+void PrepareTiles(Network* net, cv::Mat const& input, Image& image)
+{
+  std::vector<cv::Rect> tiles = FrameTiles(input);
+  size_t tile_size = (size_t)net->w * net->h * net->c;
+  if (image.data != nullptr && (image.w != net->w || image.h != net->h))
+  {
+    delete[] image.data;
+    image.data = nullptr;
+  }
+  if (image.data == nullptr)
+  {
+    image.w = net->w;
+    image.h = net->h;
+    image.c = net->c;
+    image.data = new float[tiles.size() * tile_size];
+  }
+
+  for (size_t t = 0; t < tiles.size(); t++)
+  {
+    Image tile = {net->w, net->h, net->c, image.data + t * tile_size};
+    Mat2NetworkInput(input(tiles[t]), net->w, net->h, &tile, FLAGS_letterbox);
+  }
+}
 
+// Milliseconds spent in each step of a frame
+typedef struct StepTimes
+{
+  double read;
+  double preprocess;
+  double forward;
+  double decode;
+  double nms;
+  double track;
+} StepTimes;
+
+double MsBetween(std::chrono::steady_clock::time_point start,
+    std::chrono::steady_clock::time_point end)
+{
+  using namespace std::chrono;
+  return duration_cast<nanoseconds>(end - start).count() / 1e6;
+}
+
+// Decoding and NMS of the last forward pass; the detections are copied out of
+// the network buffers, which the next forward pass overwrites
+std::vector<MostProbDet> ExtractDetections(
+    Network* net, StepTimes* times = nullptr)
+{
+  using namespace std::chrono;
+  auto start = steady_clock::now();
+  steady_clock::time_point decoded;
+
+  int num_dets = 0;
+  Detection* dets = nullptr;
+  std::vector<MostProbDet> most_prob_dets;
   layer* l = &net->layers[net->n - 1];
-  NmsSort(
-      dets, num_dets, l->classes, FLAGS_nms_thresh, l->nms_kind, l->beta_nms);
+  if (FLAGS_top_k_classes > 0)
+  {
+    SparseDetection* sparse_dets = GetSparseNetworkBoxes(
+        net, FLAGS_thresh, FLAGS_top_k_classes, &num_dets);
+    decoded = steady_clock::now();
+    NmsSort(sparse_dets, num_dets, l->classes, FLAGS_nms_thresh, l->nms_kind,
+        l->beta_nms);
+    most_prob_dets = GetMostProbDets(sparse_dets, num_dets);
+  }
+  else
+  {
+    if (net->fused_decode)
+      dets = DecodeNetworkBoxes(net, FLAGS_thresh, &num_dets);
+    else
+      dets = GetNetworkBoxes(net, FLAGS_thresh, &num_dets);
+    decoded = steady_clock::now();
+
+    NmsSort(dets, num_dets, l->classes, FLAGS_nms_thresh, l->nms_kind,
+        l->beta_nms);
+    most_prob_dets = GetMostProbDets(dets, num_dets);
+  }
+
+  if (dets != nullptr && !net->fused_decode)
+    FreeDetections(dets, num_dets);
+
+  if (times != nullptr)
+  {
+    times->decode = MsBetween(start, decoded);
+    times->nms = MsBetween(decoded, steady_clock::now());
+  }
+
+  return most_prob_dets;
+}
+
+std::vector<MostProbDet> DetectImage(
+    Network* net, Image const& image, StepTimes* times = nullptr)
+{
+  using namespace std::chrono;
+  auto start = steady_clock::now();
+  if (FLAGS_incremental_forward > 0)
+    NetworkPredictIncremental(net, image.data, FLAGS_incremental_forward);
+  else
+    NetworkPredict(net, image.data);
+  if (times != nullptr)
+    times->forward = MsBetween(start, steady_clock::now());
+
+  return ExtractDetections(net, times);
+}
+
+// One forward pass over net->batch images stored back to back in input, the
+// detections being split back per image
+void DetectBatch(Network* net, float* input,
+    std::vector<std::vector<MostProbDet>>& batch_dets,
+    StepTimes* times = nullptr)
+{
+  using namespace std::chrono;
+  auto start = steady_clock::now();
+  NetworkPredict(net, input);
+  if (times != nullptr)
+    times->forward = MsBetween(start, steady_clock::now());
+
+  batch_dets.resize(net->batch);
+  for (int b = 0; b < net->batch; b++)
+  {
+    StepTimes t = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    SelectNetworkBatch(net, b);
+    batch_dets[b] = ExtractDetections(net, &t);
+    if (times != nullptr)
+    {
+      times->decode += t.decode;
+      times->nms += t.nms;
+    }
+  }
+  SelectNetworkBatch(net, 0);
+}
+
+// Detections of the tiles prepared by PrepareTiles(), relative to the frame.
+// With a network loaded for one image per tile all tiles go through a single
+// forward pass, otherwise through one pass each.
+std::vector<MostProbDet> DetectTiles(Network* net, cv::Mat const& input,
+    Image const& image, StepTimes* times = nullptr)
+{
+  std::vector<cv::Rect> tiles = FrameTiles(input);
+  std::vector<std::vector<MostProbDet>> tile_dets;
+  if (net->batch == (int)tiles.size())
+  {
+    DetectBatch(net, image.data, tile_dets, times);
+  }
+  else
+  {
+    size_t tile_size = (size_t)net->w * net->h * net->c;
+    tile_dets.resize(tiles.size());
+    for (size_t t = 0; t < tiles.size(); t++)
+    {
+      StepTimes tile_times = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+      Image tile = {net->w, net->h, net->c, image.data + t * tile_size};
+      tile_dets[t] = DetectImage(net, tile, &tile_times);
+      if (times != nullptr)
+      {
+        times->forward += tile_times.forward;
+        times->decode += tile_times.decode;
+        times->nms += tile_times.nms;
+      }
+    }
+  }
+
+  using namespace std::chrono;
+  auto start = steady_clock::now();
+  std::vector<MostProbDet> dets;
+  std::vector<int> det_tiles;
+  for (size_t t = 0; t < tiles.size(); t++)
+  {
+    cv::Rect const& tile = tiles[t];
+    if (FLAGS_letterbox)
+      CorrectLetterboxDets(
+          tile_dets[t], tile.width, tile.height, net->w, net->h);
+    TileDetsToFrame(tile_dets[t], tile, input.cols, input.rows);
+    dets.insert(dets.end(), tile_dets[t].begin(), tile_dets[t].end());
+    det_tiles.insert(det_tiles.end(), tile_dets[t].size(), (int)t);
+  }
+  MergeTileDets(dets, det_tiles, tiles, input.cols, input.rows,
+      (float)FLAGS_nms_thresh);
+  if (times != nullptr)
+    times->nms += MsBetween(start, steady_clock::now());
+
+  return dets;
+}
+
+// Area of the frames of a camera given to the detector, relative to the frame
+// like the zones; empty for the whole frame, see --zone_roi
+Box DetectionRoi(yc::GeoInfo const& geo_info)
+{
+  if (!FLAGS_zone_roi)
+    return Box();
+
+  return geo_info.ZoneBounds((float)FLAGS_zone_roi_margin);
+}
+
+// Pixels of the frame within roi, the whole frame for an empty roi
+cv::Rect FrameRoi(cv::Mat const& input, Box const& roi)
+{
+  cv::Rect frame(0, 0, input.cols, input.rows);
+  if (roi.w <= 0 || roi.h <= 0)
+    return frame;
+
+  int x0 = (int)std::floor((roi.x - roi.w / 2) * input.cols);
+  int y0 = (int)std::floor((roi.y - roi.h / 2) * input.rows);
+  int x1 = (int)std::ceil((roi.x + roi.w / 2) * input.cols);
+  int y1 = (int)std::ceil((roi.y + roi.h / 2) * input.rows);
+  cv::Rect area = cv::Rect(x0, y0, x1 - x0, y1 - y0) & frame;
+  return area.area() > 0 ? area : frame;
+}
+
+// Boxes relative to the roi of the frame mapped back to the frame
+void FitDetsToRoi(Network* net, cv::Mat const& input, Box const& roi,
+    std::vector<MostProbDet>& dets)
+{
+  cv::Rect area = FrameRoi(input, roi);
+  FitDetsToFrame(net, input(area), dets);
+  if (area.width != input.cols || area.height != input.rows)
+    TileDetsToFrame(dets, area, input.cols, input.rows);
+}
+
+// Network input of the roi of a frame, whole or cut in tiles
+void PrepareFrame(
+    Network* net, cv::Mat const& input, Image& image, Box const& roi = Box())
+{
+  cv::Mat area = input(FrameRoi(input, roi));
+  if (!FLAGS_tiles.empty())
+    PrepareTiles(net, area, image);
+  else
+    PrepareImage(net, area, image);
+}
+
+// Detections of a frame prepared by PrepareFrame(), relative to the frame
+std::vector<MostProbDet> DetectFrame(Network* net, cv::Mat const& input,
+    Image const& image, StepTimes* times = nullptr, Box const& roi = Box())
+{
+  std::vector<MostProbDet> dets;
+  if (!FLAGS_tiles.empty())
+  {
+    cv::Rect area = FrameRoi(input, roi);
+    dets = DetectTiles(net, input(area), image, times);
+    if (area.width != input.cols || area.height != input.rows)
+      TileDetsToFrame(dets, area, input.cols, input.rows);
+  }
+  else
+  {
+    dets = DetectImage(net, image, times);
+    FitDetsToRoi(net, input, roi, dets);
+  }
+  return dets;
+}
+
+std::vector<MostProbDet> DetectObjects(Network* net, cv::Mat const& input,
+    Image& image, Box const& roi = Box(), StepTimes* times = nullptr)
+{
+  PrepareFrame(net, input, image, roi);
+  return DetectFrame(net, input, image, times, roi);
+}
+
+// Sizes of --adaptive_sizes rounded to multiples of 32, with the cfg size
+// added if missing; start is set to the index of the cfg size
+std::vector<cv::Size> AdaptiveSizes(Network* net, int& start)
+{
+  std::vector<cv::Size> sizes(1, cv::Size(net->w, net->h));
+  std::stringstream ss(FLAGS_adaptive_sizes);
+  std::string item;
+  while (std::getline(ss, item, ','))
+  {
+    int w, h;
+    if (sscanf(item.c_str(), "%dx%d", &w, &h) != 2 || w < 32 || h < 32)
+    {
+      fprintf(stderr, "Ignoring input size %s\n", item.c_str());
+      continue;
+    }
+
+    cv::Size size((w + 16) / 32 * 32, (h + 16) / 32 * 32);
+    if (std::find(sizes.begin(), sizes.end(), size) == sizes.end())
+      sizes.push_back(size);
+  }
+
+  std::stable_sort(sizes.begin(), sizes.end(),
+      [](cv::Size const& a, cv::Size const& b) {
+        return a.width * a.height < b.width * b.height;
+      });
+  cv::Size cfg_size(net->w, net->h);
+  start = (int)(std::find(sizes.begin(), sizes.end(), cfg_size) -
+                sizes.begin());
+  return sizes;
+}
+
+// Boxes of the objects of the last detector frame, the tracks when tracking
+std::vector<Box> ObjectBoxes(std::vector<MostProbDet> const& dets,
+    yc::TrackManager* track_manager)
+{
+  std::vector<Box> boxes;
+  if (track_manager != nullptr)
+  {
+    std::vector<yc::Track*> tracks;
+    track_manager->GetTracks(tracks);
+    for (size_t i = 0; i < tracks.size(); i++)
+    {
+      boxes.push_back(tracks[i]->GetBox());
+    }
+  }
+  else
+  {
+    for (size_t i = 0; i < dets.size(); i++)
+    {
+      boxes.push_back(dets[i].bbox);
+    }
+  }
+  return boxes;
+}
+
+// How much larger objects are at the network input than with the whole frame
+// stretched onto it: the network sees the roi crop, or each tile of it, and
+// a letterbox scales both axes alike
+void InputScale(Network* net, cv::Mat const& input, Box const& roi,
+    float& scale_x, float& scale_y)
+{
+  cv::Rect view = FrameRoi(input, roi);
+  if (!FLAGS_tiles.empty())
+    view = FrameTiles(input(view)).front();
+
+  scale_x = (float)input.cols / view.width;
+  scale_y = (float)input.rows / view.height;
+  if (FLAGS_letterbox)
+  {
+    float fit_x = (float)net->w / view.width;
+    float fit_y = (float)net->h / view.height;
+    float fit = min_val_cmp(fit_x, fit_y);
+    scale_x *= fit / fit_x;
+    scale_y *= fit / fit_y;
+  }
+}
 
-  std::vector<MostProbDet> most_prob_dets = GetMostProbDets(dets, num_dets);
+// Resizes the network when the controller picks another input size for the
+// next detector frames
+void AdaptResolution(Network* net, yc::ResolutionController* controller,
+    double forward_ms, std::vector<Box> const& objects, cv::Mat const& input,
+    Box const& roi)
+{
+  float scale_x, scale_y;
+  InputScale(net, input, roi, scale_x, scale_y);
+  if (!controller->Update(forward_ms, objects, scale_x, scale_y))
+    return;
+
+  cv::Size size = controller->Size();
+  printf("Input size %dx%d -> %dx%d (%.1f ms/forward)\n", net->w, net->h,
+      size.width, size.height, forward_ms);
+  ResizeNetwork(net, size.width, size.height);
+}
 
+// Draws dets, or the tracks they update when a manager is given
+void TrackDetections(Metadata const& md, std::vector<MostProbDet> const& dets,
+    cv::Mat& display, yc::TrackManager* track_manager)
+{
   if (track_manager != nullptr)
   {
     std::vector<yc::Track*> tracks;
-    track_manager->Track(most_prob_dets);
+    track_manager->Track(dets);
     track_manager->GetTracks(tracks);
 
     DrawYoloTrackings(display, tracks, md);
   }
   else
   {
-    DrawYoloDetections(display, most_prob_dets, md);
+    DrawYoloDetections(display, dets, md);
+  }
+}
+
+// Returns the detections of the frame
+std::vector<MostProbDet> ProcImage(Metadata const& md, Network* net,
+    cv::Mat const& input, cv::Mat& display, Image& image,
+    yc::TrackManager* track_manager = nullptr, Box const& roi = Box(),
+    StepTimes* times = nullptr)
+{
+  cv::resize(input, display, display.size());
+  std::vector<MostProbDet> most_prob_dets =
+      DetectObjects(net, input, image, roi, times);
+
+  TrackDetections(md, most_prob_dets, display, track_manager);
+  return most_prob_dets;
+}
+
+// Frame left unchanged since the last detections, which are used again
+void ReuseDetections(Metadata const& md, cv::Mat const& input,
+    cv::Mat& display, std::vector<MostProbDet> const& dets,
+    yc::TrackManager* track_manager)
+{
+  cv::resize(input, display, display.size());
+  TrackDetections(md, dets, display, track_manager);
+}
+
+// Frame skipped by the detector: tracks are moved by their filters only
+void PropagateTracks(Metadata const& md, cv::Mat const& input,
+    cv::Mat& display, yc::TrackManager* track_manager)
+{
+  cv::resize(input, display, display.size());
+
+  std::vector<yc::Track*> tracks;
+  track_manager->Propagate();
+  track_manager->GetTracks(tracks);
+
+  DrawYoloTrackings(display, tracks, md);
+}
+
+// Frame travelling through the video pipeline; a fixed pool of them is
+// recycled from the render stage back to the decode stage
+typedef struct VideoFrame
+{
+  int64_t index;
+  bool detect;
+  bool reuse;  // unchanged for the motion gate, the last detections apply
+  cv::Mat input;
+  cv::Mat display;
+  Image image;
+  std::vector<MostProbDet> dets;
+  std::chrono::steady_clock::time_point decoded;
+} VideoFrame;
+
+typedef struct StageStats
+{
+  char const* name;
+  double busy_ms;
+  int64_t frames;
+  int64_t queue_fill;  // input queue sizes summed over the frames
+  size_t queue_capacity;
+} StageStats;
+
+typedef yc::SpscQueue<VideoFrame*> FrameQueue;
+
+// Pops frames from in, applies work and pushes them to out until in is closed
+// and drained, then closes out
+template <typename Work>
+void RunStage(FrameQueue& in, FrameQueue& out, StageStats& stats, Work work)
+{
+  using namespace std::chrono;
+
+  VideoFrame* frame = nullptr;
+  while (in.Pop(frame))
+  {
+    stats.queue_fill += in.Size() + 1;
+
+    auto start = steady_clock::now();
+    work(frame);
+    auto end = steady_clock::now();
+
+    stats.busy_ms += duration_cast<microseconds>(end - start).count() / 1000.0;
+    stats.frames++;
+
+    out.Push(frame);
+  }
+  out.Close();
+}
+
+void PrintStageStats(std::vector<StageStats> const& stats, double wall_ms)
+{
+  printf("%11s %10s %7s %12s\n", "stage", "ms/frame", "busy", "queue fill");
+  for (size_t i = 0; i < stats.size(); i++)
+  {
+    StageStats const& s = stats[i];
+    double per_frame = s.frames > 0 ? s.busy_ms / s.frames : 0.0;
+    double busy = wall_ms > 0 ? 100.0 * s.busy_ms / wall_ms : 0.0;
+    double fill = s.frames > 0 ? (double)s.queue_fill / s.frames : 0.0;
+    printf("%11s %10.2f %6.1f%% %7.2f / %zu\n", s.name, per_frame, busy, fill,
+        s.queue_capacity);
+  }
+}
+
+// Video mode with decode, preprocess, inference, track and render stages
+// connected by bounded SPSC queues. Each stage runs in its own thread, the
+// render stage in the calling one as HighGUI wants, so the frame rate is set
+// by the slowest stage instead of the sum of all of them. The network is only
+// touched by the inference thread and the tracks by the track thread; the
+// scheduler deciding which frames are detected is shared by the preprocess
+// and track stages, and sees the tracking outcome a few frames late. With a
+// resolution controller the inference stage also prepares the network input,
+// as the input size is decided there.
+void RunVideoPipeline(Metadata const& md, Network* net,
+    cv::VideoCapture& video_capture, cv::VideoWriter& writer,
+    cv::Size display_size, int64_t max_frame,
+    yc::TrackManager* track_manager, yc::DetectScheduler* scheduler,
+    yc::MotionGate* motion_gate, Box const& roi,
+    yc::ResolutionController* controller)
+{
+  using namespace std::chrono;
+
+  size_t const queue_capacity = 4;
+  size_t const num_queues = 4;
+  size_t const num_stages = 5;
+  size_t const num_frames = num_queues * queue_capacity + num_stages;
+
+  std::vector<VideoFrame*> frames(num_frames);
+  FrameQueue free_frames(num_frames);
+  for (size_t i = 0; i < num_frames; i++)
+  {
+    frames[i] = new VideoFrame;
+    frames[i]->image = {0, 0, 0, nullptr};
+    frames[i]->display = cv::Mat::zeros(display_size, CV_8UC3);
+    free_frames.TryPush(frames[i]);
+  }
+
+  FrameQueue decoded(queue_capacity);
+  FrameQueue prepared(queue_capacity);
+  FrameQueue detected(queue_capacity);
+  FrameQueue tracked(queue_capacity);
+
+  std::vector<StageStats> stats = {
+      {"decode", 0.0, 0, 0, free_frames.Capacity()},
+      {"preprocess", 0.0, 0, 0, queue_capacity},
+      {"inference", 0.0, 0, 0, queue_capacity},
+      {"track", 0.0, 0, 0, queue_capacity},
+      {"render", 0.0, 0, 0, queue_capacity},
+  };
+
+  std::atomic<bool> stop(false);
+  std::mutex scheduler_mutex;
+
+  auto wall_start = steady_clock::now();
+
+  std::thread decode_thread([&]() {
+    int64_t index = 0;
+    VideoFrame* frame = nullptr;
+    while (!stop.load() && free_frames.Pop(frame))
+    {
+      stats[0].queue_fill += free_frames.Size() + 1;
+
+      auto start = steady_clock::now();
+      bool ok = video_capture.isOpened() && video_capture.read(frame->input);
+      auto end = steady_clock::now();
+
+      if (!ok)
+        break;
+
+      stats[0].busy_ms +=
+          duration_cast<microseconds>(end - start).count() / 1000.0;
+      stats[0].frames++;
+
+      frame->index = index++;
+      frame->decoded = start;
+      decoded.Push(frame);
+    }
+    decoded.Close();
+  });
+
+  std::thread preprocess_thread([&]() {
+    RunStage(decoded, prepared, stats[1], [&](VideoFrame* frame) {
+      frame->reuse =
+          motion_gate != nullptr && !motion_gate->Changed(frame->input);
+      if (frame->reuse)
+      {
+        frame->detect = false;
+      }
+      else if (FLAGS_disable_tracking)
+      {
+        frame->detect = true;
+      }
+      else
+      {
+        std::lock_guard<std::mutex> lock(scheduler_mutex);
+        frame->detect = scheduler->Step();
+      }
+
+      // reused detections stay those of the last detected frame
+      if (frame->detect && motion_gate != nullptr)
+        motion_gate->SetReference();
+
+      cv::resize(frame->input, frame->display, display_size);
+      if (frame->detect && controller == nullptr)
+        PrepareFrame(net, frame->input, frame->image, roi);
+    });
+  });
+
+  std::thread inference_thread([&]() {
+    RunStage(prepared, detected, stats[2], [&](VideoFrame* frame) {
+      frame->dets.clear();
+      if (frame->detect)
+      {
+        StepTimes t = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+        if (controller != nullptr)
+          PrepareFrame(net, frame->input, frame->image, roi);
+        frame->dets = DetectFrame(net, frame->input, frame->image, &t, roi);
+        if (controller != nullptr)
+          AdaptResolution(net, controller, t.forward,
+              ObjectBoxes(frame->dets, nullptr), frame->input, roi);
+      }
+    });
+  });
+
+  std::thread track_thread([&]() {
+    std::vector<MostProbDet> last_dets;
+    RunStage(detected, tracked, stats[3], [&](VideoFrame* frame) {
+      if (frame->reuse)
+        frame->dets = last_dets;
+      else if (frame->detect)
+        last_dets = frame->dets;
+
+      if (FLAGS_disable_tracking)
+      {
+        DrawYoloDetections(frame->display, frame->dets, md);
+        return;
+      }
+
+      if (frame->reuse)
+      {
+        track_manager->Track(frame->dets);
+      }
+      else if (frame->detect)
+      {
+        track_manager->Track(frame->dets);
+
+        std::lock_guard<std::mutex> lock(scheduler_mutex);
+        scheduler->Update(track_manager->GetStats());
+      }
+      else
+      {
+        track_manager->Propagate();
+      }
+
+      std::vector<yc::Track*> tracks;
+      track_manager->GetTracks(tracks);
+      DrawYoloTrackings(frame->display, tracks, md);
+    });
+  });
+
+  // render stage; after ESC the remaining frames are drained without display
+  VideoFrame* frame = nullptr;
+  while (tracked.Pop(frame))
+  {
+    stats[4].queue_fill += tracked.Size() + 1;
+
+    auto start = steady_clock::now();
+    if (!stop.load())
+    {
+      if (FLAGS_save_output)
+        writer << frame->display;
+
+      DrawProcTime(frame->display,
+          duration_cast<milliseconds>(start - frame->decoded).count());
+      DrawFrameInfo(frame->display, frame->index, max_frame);
+
+      cv::imshow(FLAGS_mode, frame->display);
+      if (cv::waitKey(1) == 27)
+        stop.store(true);
+    }
+    auto end = steady_clock::now();
+
+    stats[4].busy_ms +=
+        duration_cast<microseconds>(end - start).count() / 1000.0;
+    stats[4].frames++;
+
+    free_frames.Push(frame);
+  }
+
+  decode_thread.join();
+  preprocess_thread.join();
+  inference_thread.join();
+  track_thread.join();
+
+  auto wall_end = steady_clock::now();
+  double wall_ms =
+      duration_cast<microseconds>(wall_end - wall_start).count() / 1000.0;
+
+  printf("Pipeline: %lld frames in %.1f s, %.1f fps\n",
+      (long long)stats[4].frames, wall_ms / 1000.0,
+      wall_ms > 0 ? 1000.0 * stats[4].frames / wall_ms : 0.0);
+  PrintStageStats(stats, wall_ms);
+
+  for (size_t i = 0; i < num_frames; i++)
+  {
+    if (frames[i]->image.data != nullptr)
+      delete[] frames[i]->image.data;
+    delete frames[i];
+  }
+}
+
+// Times every NMS kind on the same synthetic detections, i.e. clusters of
+// jittered boxes around random objects, and reports the surviving boxes
+void BenchmarkNms(int num_boxes, int classes, float thresh, int reps = 10)
+{
+  int const box_per_obj = 20;
+  auto uniform = [](float min, float max) {
+    return min + (max - min) * rand() / (float)RAND_MAX;
+  };
+
+  Detection* dets = (Detection*)calloc(num_boxes, sizeof(Detection));
+  float obj_x = 0, obj_y = 0, obj_w = 0, obj_h = 0;
+  int obj_cls = 0;
+  for (int i = 0; i < num_boxes; ++i)
+  {
+    if (i % box_per_obj == 0)
+    {
+      obj_w = uniform(0.02f, 0.2f);
+      obj_h = uniform(0.02f, 0.2f);
+      obj_x = uniform(obj_w / 2, 1 - obj_w / 2);
+      obj_y = uniform(obj_h / 2, 1 - obj_h / 2);
+      obj_cls = rand() % classes;
+    }
+
+    dets[i].bbox.x = obj_x + obj_w * uniform(-0.1f, 0.1f);
+    dets[i].bbox.y = obj_y + obj_h * uniform(-0.1f, 0.1f);
+    dets[i].bbox.w = obj_w * uniform(0.8f, 1.2f);
+    dets[i].bbox.h = obj_h * uniform(0.8f, 1.2f);
+    dets[i].classes = classes;
+    dets[i].prob = (float*)calloc(classes, sizeof(float));
+    dets[i].prob[obj_cls] = uniform(0.25f, 1.0f);
+  }
+
+  std::vector<Detection> orig(dets, dets + num_boxes);
+  for (int i = 0; i < num_boxes; ++i)
+  {
+    orig[i].prob = (float*)calloc(classes, sizeof(float));
+    std::copy(dets[i].prob, dets[i].prob + classes, orig[i].prob);
+  }
+
+  char const* names[] = {"greedy", "diou", "grid", "fast", "matrix"};
+  NMS_KIND kinds[] = {GREEDY_NMS, DIOU_NMS, GRID_NMS, FAST_NMS, MATRIX_NMS};
+
+  printf("NMS benchmark: %d boxes, %d classes, thresh %.2f\n", num_boxes,
+      classes, thresh);
+  for (int k = 0; k < 5; ++k)
+  {
+    using namespace std::chrono;
+    double total_ms = 0.0;
+    int survivors = 0;
+    for (int r = 0; r < reps; ++r)
+    {
+      for (int i = 0; i < num_boxes; ++i)
+      {
+        std::copy(orig[i].prob, orig[i].prob + classes, dets[i].prob);
+      }
+
+      auto start = steady_clock::now();
+      NmsSort(dets, num_boxes, classes, thresh, kinds[k], 0.6f);
+      auto end = steady_clock::now();
+      total_ms += duration_cast<microseconds>(end - start).count() / 1000.0;
+
+      survivors = (int)GetMostProbDets(dets, num_boxes).size();
+    }
+    printf("%8s: %9.3f ms, %d boxes kept\n", names[k], total_ms / reps,
+        survivors);
+  }
+
+  FreeDetections(dets, num_boxes);
+  for (int i = 0; i < num_boxes; ++i)
+  {
+    free(orig[i].prob);
+  }
+}
+
+bool IsImageFile(std::string const& path)
+{
+  size_t idx = path.find_last_of('.');
+  if (idx == std::string::npos)
+    return false;
+
+  std::string ext = path.substr(idx + 1);
+  std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+  return ext == "jpg" || ext == "jpeg" || ext == "png" || ext == "bmp";
+}
+
+std::string JsonQuote(std::string const& str)
+{
+  std::string quoted = "\"";
+  for (size_t i = 0; i < str.size(); i++)
+  {
+    if (str[i] == '"' || str[i] == '\\')
+      quoted += '\\';
+    quoted += str[i];
+  }
+  return quoted + "\"";
+}
+
+// Nearest-rank percentile of ascending values
+double Percentile(std::vector<double> const& sorted, double p)
+{
+  if (sorted.empty())
+    return 0.0;
+
+  size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+  return sorted[std::max(rank, (size_t)1) - 1];
+}
+
+// Runs detection and tracking without any window on a video, on images given
+// by a comma-separated or .txt list, or on random frames, and reports
+// throughput, end-to-end latency and the mean time of each step as JSON.
+// Images and random frames are held in memory and cycled, so reading costs
+// time for videos only. The first bench_warmup frames are not timed.
+int BenchmarkDetector(Network* net, std::vector<std::string> const& files)
+{
+  std::string source;
+  std::vector<cv::Mat> frames;
+  cv::VideoCapture video_capture;
+  double fps = 30.0;
+
+  if (!FLAGS_bench_synthetic.empty())
+  {
+    int w = 0, h = 0;
+    if (sscanf(FLAGS_bench_synthetic.c_str(), "%dx%d", &w, &h) != 2 ||
+        w <= 0 || h <= 0)
+    {
+      fprintf(stderr, "Invalid bench_synthetic %s, expected WxH\n",
+          FLAGS_bench_synthetic.c_str());
+      return -1;
+    }
+
+    source = "synthetic";
+    cv::RNG rng(0x5eed);
+    for (int i = 0; i < 8; i++)
+    {
+      cv::Mat frame(h, w, CV_8UC3);
+      rng.fill(
+          frame, cv::RNG::UNIFORM, cv::Scalar::all(0), cv::Scalar::all(256));
+      frames.push_back(frame);
+    }
+  }
+  else
+  {
+    std::vector<std::string> paths;
+    std::string const& front = files.front();
+    if (files.size() == 1 && front.size() > 4 &&
+        front.compare(front.size() - 4, 4, ".txt") == 0)
+    {
+      std::ifstream list(front);
+      std::string line;
+      while (std::getline(list, line))
+      {
+        if (!line.empty() && line.back() == '\r')
+          line.pop_back();
+        if (!line.empty())
+          paths.push_back(line);
+      }
+    }
+    else if (std::all_of(files.begin(), files.end(), IsImageFile))
+    {
+      paths = files;
+    }
+
+    if (!paths.empty())
+    {
+      source = "images";
+      for (size_t i = 0; i < paths.size(); i++)
+      {
+        cv::Mat frame = cv::imread(paths[i]);
+        if (frame.empty())
+          fprintf(stderr, "Cannot read image %s\n", paths[i].c_str());
+        else
+          frames.push_back(frame);
+      }
+
+      if (frames.empty())
+        return -1;
+    }
+    else
+    {
+      source = "video";
+      if (!video_capture.open(front))
+      {
+        fprintf(stderr, "Cannot open video %s\n", front.c_str());
+        return -1;
+      }
+
+      double video_fps = video_capture.get(cv::CAP_PROP_FPS);
+      if (video_fps > 0)
+        fps = video_fps;
+    }
+  }
+
+  int min_conf = std::max((int)(fps / 5), 1);
+  yc::ConfParam conf_param(1, min_conf, 2 * min_conf);
+  yc::TrackManager track_manager(conf_param, fps, 0.3);
+
+  yc::MotionGate motion_gate((float)FLAGS_motion_thresh, FLAGS_motion_max_skip);
+  bool motion_gated = FLAGS_motion_thresh > 0;
+  if (motion_gated && !FLAGS_motion_mask.empty())
+    motion_gate.SetMask(cv::imread(FLAGS_motion_mask, cv::IMREAD_GRAYSCALE));
+  std::vector<MostProbDet> last_dets;
+  int num_skipped = 0;
+  double sum_dirty = 0.0;
+
+  using namespace std::chrono;
+
+  Image image = {0, 0, 0, nullptr};
+  cv::Mat input;
+  size_t next_frame = 0;
+  int frame_w = 0, frame_h = 0;
+
+  std::vector<double> latencies;
+  StepTimes sum = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+  steady_clock::time_point bench_start = steady_clock::now();
+
+  int total = FLAGS_bench_warmup + FLAGS_bench_frames;
+  for (int i = 0; i < total; i++)
+  {
+    if (i == FLAGS_bench_warmup)
+      bench_start = steady_clock::now();
+
+    StepTimes t = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    auto start = steady_clock::now();
+    if (frames.empty())
+    {
+      if (!video_capture.read(input))
+        break;
+    }
+    else
+    {
+      input = frames[next_frame++ % frames.size()];
+    }
+    auto read = steady_clock::now();
+
+    // static frames reuse the last detections, see MotionGate
+    bool reuse = motion_gated && !motion_gate.Changed(input);
+    if (!reuse)
+    {
+      if (motion_gated)
+        motion_gate.SetReference();
+      PrepareFrame(net, input, image);
+    }
+    auto prepared = steady_clock::now();
+
+    std::vector<MostProbDet> dets = last_dets;
+    if (!reuse)
+    {
+      dets = DetectFrame(net, input, image, &t);
+      last_dets = dets;
+      if (i >= FLAGS_bench_warmup)
+        sum_dirty += net->inc_dirty;
+    }
+    auto detected = steady_clock::now();
+
+    if (!FLAGS_disable_tracking)
+      track_manager.Track(dets);
+    auto end = steady_clock::now();
+
+    frame_w = input.cols;
+    frame_h = input.rows;
+    if (i < FLAGS_bench_warmup)
+      continue;
+
+    num_skipped += reuse;
+    latencies.push_back(MsBetween(start, end));
+    sum.read += MsBetween(start, read);
+    sum.preprocess += MsBetween(read, prepared);
+    sum.forward += t.forward;
+    sum.decode += t.decode;
+    sum.nms += t.nms;
+    sum.track += MsBetween(detected, end);
+  }
+  double wall_ms = MsBetween(bench_start, steady_clock::now());
+
+  if (image.data != nullptr)
+    delete[] image.data;
+
+  int n = (int)latencies.size();
+  if (n == 0)
+  {
+    fprintf(stderr, "No frame left to time after %d warmup frames\n",
+        FLAGS_bench_warmup);
+    return -1;
   }
 
-  FreeDetections(dets, num_dets);
+  double mean = std::accumulate(latencies.begin(), latencies.end(), 0.0) / n;
+  std::sort(latencies.begin(), latencies.end());
+
+  FILE* fp = stdout;
+  if (!FLAGS_bench_json.empty())
+  {
+    fp = fopen(FLAGS_bench_json.c_str(), "w");
+    if (fp == nullptr)
+    {
+      fprintf(stderr, "Cannot open %s\n", FLAGS_bench_json.c_str());
+      return -1;
+    }
+  }
+
+  std::string input_name =
+      source == "synthetic" ? FLAGS_bench_synthetic : files.front();
+  fprintf(fp, "{\n");
+  fprintf(fp, "  \"model\": %s,\n", JsonQuote(FLAGS_model_file).c_str());
+  fprintf(fp, "  \"source\": \"%s\",\n", source.c_str());
+  fprintf(fp, "  \"input\": %s,\n", JsonQuote(input_name).c_str());
+  fprintf(fp, "  \"frame_size\": [%d, %d],\n", frame_w, frame_h);
+  fprintf(fp, "  \"network_size\": [%d, %d],\n", net->w, net->h);
+  int tile_cols, tile_rows;
+  if (TileGrid(tile_cols, tile_rows))
+  {
+    fprintf(fp, "  \"tiles\": [%d, %d],\n", tile_cols, tile_rows);
+    fprintf(fp, "  \"tile_overlap\": %.3f,\n", FLAGS_tile_overlap);
+  }
+  fprintf(fp, "  \"tracking\": %s,\n",
+      FLAGS_disable_tracking ? "false" : "true");
+  fprintf(fp, "  \"warmup_frames\": %d,\n", FLAGS_bench_warmup);
+  fprintf(fp, "  \"frames\": %d,\n", n);
+  fprintf(fp, "  \"fps\": %.3f,\n", wall_ms > 0 ? 1000.0 * n / wall_ms : 0.0);
+  if (motion_gated)
+  {
+    fprintf(fp, "  \"motion_gate\": {\n");
+    fprintf(fp, "    \"threshold\": %.3f,\n", FLAGS_motion_thresh);
+    double skip_rate = (double)num_skipped / n;
+    fprintf(fp, "    \"skip_rate\": %.4f,\n", skip_rate);
+    fprintf(fp, "    \"inference_rate\": %.4f\n", 1.0 - skip_rate);
+    fprintf(fp, "  },\n");
+  }
+  if (FLAGS_incremental_forward > 0)
+  {
+    int num_forward = n - num_skipped;
+    fprintf(fp, "  \"incremental_forward\": {\n");
+    fprintf(fp, "    \"max_dirty\": %.3f,\n", FLAGS_incremental_forward);
+    fprintf(fp, "    \"mean_dirty\": %.4f\n",
+        num_forward > 0 ? sum_dirty / num_forward : 0.0);
+    fprintf(fp, "  },\n");
+  }
+  fprintf(fp, "  \"latency_ms\": {\n");
+  fprintf(fp, "    \"mean\": %.3f,\n", mean);
+  fprintf(fp, "    \"p50\": %.3f,\n", Percentile(latencies, 50));
+  fprintf(fp, "    \"p95\": %.3f,\n", Percentile(latencies, 95));
+  fprintf(fp, "    \"p99\": %.3f,\n", Percentile(latencies, 99));
+  fprintf(fp, "    \"max\": %.3f\n", latencies.back());
+  fprintf(fp, "  },\n");
+  fprintf(fp, "  \"stage_ms\": {\n");
+  fprintf(fp, "    \"read\": %.3f,\n", sum.read / n);
+  fprintf(fp, "    \"preprocess\": %.3f,\n", sum.preprocess / n);
+  fprintf(fp, "    \"forward\": %.3f,\n", sum.forward / n);
+  fprintf(fp, "    \"decode\": %.3f,\n", sum.decode / n);
+  fprintf(fp, "    \"nms\": %.3f,\n", sum.nms / n);
+  fprintf(fp, "    \"tracking\": %.3f\n", sum.track / n);
+  fprintf(fp, "  }\n");
+  fprintf(fp, "}\n");
+
+  if (fp != stdout)
+    fclose(fp);
+
+  return 0;
 }
 
 int main(int argc, char** argv)
@@ -159,12 +1292,33 @@ int main(int argc, char** argv)
         FLAGS_num_gpus, FLAGS_clear, FLAGS_show_imgs, FLAGS_calc_map,
         FLAGS_benchmark_layers);
   }
+  else if (FLAGS_mode == "nms-bench")
+  {
+    BenchmarkNms(
+        FLAGS_nms_bench_boxes, FLAGS_nms_bench_classes, FLAGS_nms_thresh);
+  }
   else
   {
+    std::vector<std::string> files;
+    SeparateInputFiles(files);
+
+    // the frames of all cameras, or all tiles of a frame, go through the
+    // network as one batch
+    int batch = 1;
+    int tile_cols, tile_rows;
+    if (TileGrid(tile_cols, tile_rows))
+      batch = tile_cols * tile_rows;
+    else if (FLAGS_mode == "video" && files.size() > 1)
+      batch = (int)files.size();
+
     Network* net = (Network*)calloc(1, sizeof(Network));
-    LoadNetwork(net, FLAGS_model_file.c_str(), FLAGS_weights_file.c_str());
+    LoadNetwork(net, FLAGS_model_file.c_str(), FLAGS_weights_file.c_str(),
+        false, false, batch);
+    if (FLAGS_head_mask != -1)
+      SetDetectionHeadMask(net, (uint32_t)FLAGS_head_mask);
+    net->fused_decode = FLAGS_fused_decode;
 
-    cv::Mat resize, display;
+    cv::Mat display;
     Image image = {0, 0, 0, nullptr};
 
     // calculate mAP@0.5
@@ -174,8 +1328,14 @@ int main(int argc, char** argv)
       return 0;
     }
 
-    std::vector<std::string> files;
-    SeparateInputFiles(files);
+    // headless timing, see BenchmarkDetector()
+    if (FLAGS_mode == "bench")
+    {
+      int ret = BenchmarkDetector(net, files);
+      FreeNetwork(net);
+      free(net);
+      return ret;
+    }
 
     std::vector<yc::GeoInfo> geo_infos(files.size());
     for (size_t i = 0; i < files.size(); i++)
@@ -187,7 +1347,15 @@ int main(int argc, char** argv)
       int end = path.find_last_of('.');
 
       std::string xml_path = path.substr(start + 1, path.size() - end) + "xml";
-      geo_infos[i].Load(xml_path);
+      geo_infos[i].Load(xml_path, FLAGS_zone_raster);
+    }
+
+    // the zones area keeps its aspect ratio in the network input, and tiles
+    // cover it instead of --tile_roi
+    if (FLAGS_zone_roi)
+    {
+      FLAGS_letterbox = true;
+      FLAGS_tile_roi.clear();
     }
 
     // processing a single image
@@ -202,7 +1370,8 @@ int main(int argc, char** argv)
       using namespace std::chrono;
       auto start = system_clock::now();
       ///
-      ProcImage(md, net, input, resize, display, image);
+      ProcImage(md, net, input, display, image, nullptr,
+          DetectionRoi(geo_infos.front()));
       ///
       auto end = system_clock::now();
 
@@ -244,29 +1413,113 @@ int main(int argc, char** argv)
       int min_conf = (int)(fps / 5);
       yc::ConfParam conf_param(1, min_conf, 2 * min_conf);
       yc::TrackManager track_manager(conf_param, fps, 0.3);
+      yc::DetectScheduler scheduler(FLAGS_max_detect_interval);
+      if (!FLAGS_track_log.empty())
+        track_manager.OpenTrackLog(FLAGS_track_log);
+
+      yc::MotionGate motion_gate(
+          (float)FLAGS_motion_thresh, FLAGS_motion_max_skip);
+      bool motion_gated = FLAGS_motion_thresh > 0;
+      if (motion_gated && !FLAGS_motion_mask.empty())
+      {
+        cv::Mat mask = cv::imread(FLAGS_motion_mask, cv::IMREAD_GRAYSCALE);
+        if (mask.empty())
+          fprintf(stderr, "Cannot read motion mask %s, watching the whole "
+              "frame\n", FLAGS_motion_mask.c_str());
+        motion_gate.SetMask(mask);
+      }
+
+      // input size following the latency budget, see ResolutionController
+      int start_size = 0;
+      std::vector<cv::Size> sizes = AdaptiveSizes(net, start_size);
+      yc::ResolutionController controller(sizes, FLAGS_latency_budget,
+          start_size, (float)FLAGS_adaptive_min_object, FLAGS_adaptive_hold);
+      bool adaptive = !FLAGS_adaptive_sizes.empty();
 
-      cv::Mat input;
-      while (video_capture.isOpened() && video_capture.read(input))
+      Box roi = DetectionRoi(geo_infos.front());
+      if (FLAGS_pipeline)
       {
-        using namespace std::chrono;
-        auto start = system_clock::now();
-        ///
-        if (FLAGS_disable_tracking)
-          ProcImage(md, net, input, resize, display, image);
-        else
-          ProcImage(md, net, input, resize, display, image, &track_manager);
-        ///
-        auto end = system_clock::now();
+        RunVideoPipeline(md, net, video_capture, writer, display.size(),
+            max_frame, &track_manager, &scheduler,
+            motion_gated ? &motion_gate : nullptr, roi,
+            adaptive ? &controller : nullptr);
+      }
+      else
+      {
+        cv::Mat input;
+        std::vector<MostProbDet> last_dets;
+        while (video_capture.isOpened() && video_capture.read(input))
+        {
+          using namespace std::chrono;
+          auto start = system_clock::now();
+          ///
+          StepTimes t = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+          bool detected = false;
+          if (motion_gated && !motion_gate.Changed(input))
+          {
+            ReuseDetections(md, input, display, last_dets,
+                FLAGS_disable_tracking ? nullptr : &track_manager);
+          }
+          else if (FLAGS_disable_tracking)
+          {
+            last_dets =
+                ProcImage(md, net, input, display, image, nullptr, roi, &t);
+            detected = true;
+          }
+          else if (scheduler.Step())
+          {
+            last_dets = ProcImage(
+                md, net, input, display, image, &track_manager, roi, &t);
+            scheduler.Update(track_manager.GetStats());
+            detected = true;
+          }
+          else
+          {
+            PropagateTracks(md, input, display, &track_manager);
+          }
 
-        if (FLAGS_save_output)
-          writer << display;
+          // reused detections stay those of the last detected frame
+          if (detected && motion_gated)
+            motion_gate.SetReference();
 
-        DrawProcTime(display, duration_cast<milliseconds>(end - start).count());
-        DrawFrameInfo(display, curr_frame++, max_frame);
+          if (detected && adaptive)
+            AdaptResolution(net, &controller, t.forward,
+                ObjectBoxes(last_dets,
+                    FLAGS_disable_tracking ? nullptr : &track_manager),
+                input, roi);
+          ///
+          auto end = system_clock::now();
 
-        cv::imshow(FLAGS_mode, display);
-        if (cv::waitKey(1) == 27)
-          break;
+          if (FLAGS_save_output)
+            writer << display;
+
+          DrawProcTime(
+              display, duration_cast<milliseconds>(end - start).count());
+          DrawFrameInfo(display, curr_frame++, max_frame);
+
+          cv::imshow(FLAGS_mode, display);
+          if (cv::waitKey(1) == 27)
+            break;
+        }
+      }
+
+      if (!FLAGS_disable_tracking)
+        printf("Detector duty cycle: %.1f%% (%lld of %lld frames)\n",
+            100.0 * scheduler.DutyCycle(), scheduler.NumDetections(),
+            scheduler.NumFrames());
+
+      if (motion_gated)
+        printf("Motion gate: %.1f%% skipped, %.1f%% passed of %lld frames\n",
+            100.0 * motion_gate.SkipRate(), 100.0 * motion_gate.InferenceRate(),
+            motion_gate.NumFrames());
+
+      if (adaptive)
+      {
+        cv::Size size = controller.Size();
+        printf("Adaptive input size: %d switches, ended at %dx%d with %.1f "
+               "ms/forward\n",
+            controller.NumSwitches(), size.width, size.height,
+            controller.ForwardTime(controller.Level()));
       }
 
       if (image.data != nullptr)
@@ -306,14 +1559,36 @@ int main(int argc, char** argv)
       Image* images = new Image[files.size()];
       std::vector<yc::TrackManager*> track_managers(files.size());
       std::vector<cv::Mat> inputs(files.size());
-      std::vector<cv::Mat> resizes(files.size());
       std::vector<cv::Mat> displays(files.size());
+      std::vector<std::vector<MostProbDet>> cam_dets(files.size());
+      std::vector<Box> rois(files.size());
+      for (size_t i = 0; i < files.size(); i++)
+      {
+        rois[i] = DetectionRoi(geo_infos[i]);
+      }
+
+      // with a network loaded for one image per camera, images[i] is slot i
+      // of a single input tensor going through one forward pass per frame
+      bool batched = net->batch == (int)files.size() && FLAGS_tiles.empty();
+      size_t image_size = (size_t)net->w * net->h * net->c;
+      std::vector<float> batch_input;
+      if (batched)
+        batch_input.resize(files.size() * image_size);
+
+      yc::HandoverGraph handover_graph;
+      handover_graph.Build(geo_infos, fps);
       for (size_t i = 0; i < track_managers.size(); i++)
       {
         images[i].data = nullptr;
+        if (batched)
+          images[i] = {net->w, net->h, net->c, &batch_input[i * image_size]};
         displays[i] = cv::Mat::zeros(
             img_height / files.size(), img_width / files.size(), CV_8UC3);
-        track_managers[i] = new yc::TrackManager(conf_param, fps, 0.3);
+        track_managers[i] = new yc::TrackManager(
+            conf_param, fps, 0.3, (int)i, (int)files.size());
+        if (!FLAGS_track_log.empty())
+          track_managers[i]->OpenTrackLog(
+              FLAGS_track_log + "." + std::to_string(i));
       }
 
       bool run = true;
@@ -337,23 +1612,51 @@ int main(int argc, char** argv)
         using namespace std::chrono;
         auto start = system_clock::now();
         ///
-        for (size_t i = 0; i < inputs.size(); i++)
+        if (batched)
         {
-          if (FLAGS_disable_tracking)
-            ProcImage(md, net, inputs[i], resizes[i], displays[i], images[i]);
-          else
-            ProcImage(md, net, inputs[i], resizes[i], displays[i], images[i],
-                track_managers[i]);
+#pragma omp parallel for
+          for (int i = 0; i < (int)inputs.size(); i++)
+          {
+            cv::resize(inputs[i], displays[i], displays[i].size());
+            PrepareFrame(net, inputs[i], images[i], rois[i]);
+          }
+          DetectBatch(net, batch_input.data(), cam_dets);
 
+          for (size_t i = 0; i < inputs.size(); i++)
+          {
+            FitDetsToRoi(net, inputs[i], rois[i], cam_dets[i]);
+          }
+        }
+        else
+        {
+          // the network is shared, so detection runs camera by camera
+          for (size_t i = 0; i < inputs.size(); i++)
+          {
+            cv::resize(inputs[i], displays[i], displays[i].size());
+            cam_dets[i] =
+                DetectObjects(net, inputs[i], images[i], rois[i]);
+          }
+        }
+
+        // the trackers run in parallel
+
+        if (!FLAGS_disable_tracking)
+          yc::TrackCameras(track_managers, cam_dets);
+
+        for (size_t i = 0; i < inputs.size(); i++)
+        {
           std::vector<yc::Track*> tracks;
           track_managers[i]->GetTracks(tracks);
 
+          if (FLAGS_disable_tracking)
+            DrawYoloDetections(displays[i], cam_dets[i], md);
+          else
+            DrawYoloTrackings(displays[i], tracks, md);
+
           geo_infos[i].Proc(tracks);
           geo_infos[i].Draw(displays[i]);
         }
-        yc::Handover* h1 = geo_infos[1].GetHandoverRegion(0);
-        yc::Handover* h2 = geo_infos[0].GetHandoverRegion(1);
-        yc::Handover::Crosstalk(h1, h2);
+        handover_graph.Match();
         ///
         auto end = system_clock::now();
 
@@ -380,7 +1683,7 @@ int main(int argc, char** argv)
           break;
       }
 
-      for (size_t i = 0; i < files.size(); i++)
+      for (size_t i = 0; i < files.size() && !batched; i++)
       {
         if (images[i].data != nullptr)
           delete[] images[i].data;
@@ -466,6 +466,19 @@ typedef struct Network
   float* output;
   LearningRatePolicy policy;
   int benchmark_layers;
+  int* skip_layers;  // layers feeding only disabled detection heads
+  int fused_decode;  // keep yolo outputs as logits, decode them lazily
+
+  Detection* decode_dets;  // buffer returned by DecodeNetworkBoxes()
+  int max_decode_dets;
+  SparseDetection* sparse_dets;  // buffer returned by GetSparseNetworkBoxes()
+  ClassProb* sparse_probs;
+  int max_sparse_dets;
+  int sparse_top_k;
+  int batch_index;  // image read by the box decoders, see SelectNetworkBatch()
+  float* inc_input;  // last input of NetworkPredictIncremental()
+  int inc_valid;     // layer outputs still belong to inc_input
+  float inc_dirty;   // input fraction recomputed by the last incremental pass
 
   float lr;
   float lr_min;
@@ -621,21 +634,68 @@ typedef struct BoxLabel
   float left, right, top, bottom;
 } BoxLabel;
 
+// network.h
+// Growable output buffer of the detection serializers; zero-initialize it,
+// reset size to 0 to reuse it across frames and release it by FreeDetBuffer()
+typedef struct DetBuffer
+{
+  char* data;
+  size_t size;
+  size_t capacity;
+} DetBuffer;
+
+// Binary detection format: a DetFrameHeader followed by num_objects
+// DetRecords, both in native byte order and without padding
+typedef struct DetFrameHeader
+{
+  int64_t frame_id;
+  int32_t num_objects;
+  int32_t reserved;
+} DetFrameHeader;
+
+typedef struct DetRecord
+{
+  int32_t class_id;
+  float x, y, w, h;
+  float confidence;
+} DetRecord;
+
 // parser.c
 LIB_API bool LoadNetwork(Network* net, char const* model_file,
-    char const* weights_file, bool train = false, bool clear = false);
+    char const* weights_file, bool train = false, bool clear = false,
+    int batch = 1);
 LIB_API void FreeNetwork(Network* net);
 
 // network.h
 LIB_API float* NetworkPredict(Network* net, float* input);
+LIB_API void SelectNetworkBatch(Network* net, int b);
+LIB_API void ResizeNetwork(Network* net, int w, int h);
+LIB_API float* NetworkPredictIncremental(
+    Network* net, float* input, float max_dirty = 0.5f);
 LIB_API Detection* GetNetworkBoxes(Network* net, float thresh, int* num);
 LIB_API void FreeDetections(Detection* dets, int n);
+LIB_API Detection* DecodeNetworkBoxes(Network* net, float thresh, int* num);
+LIB_API SparseDetection* GetSparseNetworkBoxes(
+    Network* net, float thresh, int top_k, int* num);
 LIB_API void FuseConvBatchNorm(Network* net);
 LIB_API void calculate_binary_weights(Network net);
 LIB_API char* Detection2Json(Detection* dets, int nboxes, int classes,
     char** names, long long int frame_id, char const* filename);
+LIB_API bool AppendDetectionJson(DetBuffer* buf, Detection* dets, int nboxes,
+    int classes, char** names, long long int frame_id, char const* filename);
+LIB_API bool AppendDetectionBinary(DetBuffer* buf, Detection* dets,
+    int nboxes, int classes, char** names, long long int frame_id);
+LIB_API bool AppendSparseDetectionJson(DetBuffer* buf, SparseDetection* dets,
+    int nboxes, int classes, char** names, long long int frame_id,
+    char const* filename);
+LIB_API bool AppendSparseDetectionBinary(DetBuffer* buf,
+    SparseDetection* dets, int nboxes, int classes, char** names,
+    long long int frame_id);
+LIB_API void FreeDetBuffer(DetBuffer* buf);
 
 LIB_API Detection* MakeNetworkBoxes(Network* net, float thresh, int* num);
+LIB_API int NumDetectionHeads(Network* net);
+LIB_API void SetDetectionHeadMask(Network* net, uint32_t mask);
 
 LIB_API void TrainDetector(Metadata const& md, std::string model_file,
     std::string weights_file, int num_gpus, bool clear, bool show_imgs,
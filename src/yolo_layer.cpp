@@ -7,9 +7,12 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <vector>
+
 #include "activations.h"
 #include "blas.h"
 #include "box.h"
+#include "box_batch.h"
 #include "dark_cuda.h"
 #include "utils.h"
 
@@ -390,6 +393,10 @@ void ForwardYoloLayer(layer* l, NetworkState state)
   int i, j, b, t, n;
   memcpy(l->output, state.input, l->outputs * l->batch * sizeof(float));
 
+  // outputs stay raw logits, see GetFusedYoloDetections()
+  if (!state.train && state.net->fused_decode)
+    return;
+
 #ifndef GPU
   for (b = 0; b < l->batch; ++b)
   {
@@ -427,8 +434,41 @@ void ForwardYoloLayer(layer* l, NetworkState state)
   int count = 0;
   int class_count = 0;
   *(l->cost) = 0;
+  BoxBatch truths;
+  std::vector<int> truth_idx;
+  std::vector<float> ious;
   for (b = 0; b < l->batch; ++b)
   {
+    // every cell is matched against the same truths, so gather them once
+    truths.Clear();
+    truth_idx.clear();
+    for (t = 0; t < l->max_boxes; ++t)
+    {
+      Box truth(state.truth + t * (4 + 1) + b * l->truths);
+      int class_id = state.truth[t * (4 + 1) + b * l->truths + 4];
+      if (class_id >= l->classes || class_id < 0)
+      {
+        printf(
+            "\n Warning: in txt-labels class_id=%d >= classes=%d in "
+            "cfg-file. In txt-labels class_id should be [from 0 to %d] "
+            "\n",
+            class_id, l->classes, l->classes - 1);
+        printf(
+            "\n truth.x = %f, truth.y = %f, truth.w = %f, truth.h = %f, "
+            "class_id = %d \n",
+            truth.x, truth.y, truth.w, truth.h, class_id);
+        continue;  // if label contains class_id more than number of
+                   // classes in the cfg-file and class_id check garbage
+                   // value
+      }
+      if (!truth.x)
+        break;  // continue;
+
+      truths.Push(truth);
+      truth_idx.push_back(t);
+    }
+    ious.resize(truths.Size());
+
     for (j = 0; j < l->h; ++j)
     {
       for (i = 0; i < l->w; ++i)
@@ -441,46 +481,30 @@ void ForwardYoloLayer(layer* l, NetworkState state)
           float best_match_iou = 0;
           float best_iou = 0;
           int best_t = 0;
-          for (t = 0; t < l->max_boxes; ++t)
+          if (truths.Size() > 0)
           {
-            Box truth(state.truth + t * (4 + 1) + b * l->truths);
-            int class_id = state.truth[t * (4 + 1) + b * l->truths + 4];
-            if (class_id >= l->classes || class_id < 0)
-            {
-              printf(
-                  "\n Warning: in txt-labels class_id=%d >= classes=%d in "
-                  "cfg-file. In txt-labels class_id should be [from 0 to %d] "
-                  "\n",
-                  class_id, l->classes, l->classes - 1);
-              printf(
-                  "\n truth.x = %f, truth.y = %f, truth.w = %f, truth.h = %f, "
-                  "class_id = %d \n",
-                  truth.x, truth.y, truth.w, truth.h, class_id);
-              continue;  // if label contains class_id more than number of
-                         // classes in the cfg-file and class_id check garbage
-                         // value
-            }
-            if (!truth.x)
-              break;  // continue;
-
             int class_index =
                 EntryIndex(l, b, n * l->w * l->h + j * l->w + i, 4 + 1);
             int obj_index = EntryIndex(l, b, n * l->w * l->h + j * l->w + i, 4);
             float objectness = l->output[obj_index];
             if (isnan(objectness) || isinf(objectness))
               l->output[obj_index] = 0;
+            // any class above 0.25 matches, whichever truth is compared
             int class_id_match = compare_yolo_class(l->output, l->classes,
-                class_index, l->w * l->h, objectness, class_id, 0.25f);
+                class_index, l->w * l->h, objectness, -1, 0.25f);
 
-            float iou = Box::Iou(pred, truth);
-            if (iou > best_match_iou && class_id_match == 1)
-            {
-              best_match_iou = iou;
-            }
-            if (iou > best_iou)
+            truths.Iou(pred, 0, truths.Size(), ious.data());
+            for (int k = 0; k < truths.Size(); ++k)
             {
-              best_iou = iou;
-              best_t = t;
+              if (ious[k] > best_match_iou && class_id_match == 1)
+              {
+                best_match_iou = ious[k];
+              }
+              if (ious[k] > best_iou)
+              {
+                best_iou = ious[k];
+                best_t = truth_idx[k];
+              }
             }
           }
           int obj_index = EntryIndex(l, b, n * l->w * l->h + j * l->w + i, 4);
@@ -831,11 +855,170 @@ int GetYoloDetections(
   return count;
 }
 
+// sigmoid(x) > thresh holds only if x > logit(thresh). The bound is loosened
+// by a small margin so that rounding near the threshold never drops a cell;
+// survivors are checked again after the sigmoid.
+static float LogitThresh(float thresh)
+{
+  if (thresh <= 0)
+    return -FLT_MAX;
+  if (thresh >= 1)
+    return FLT_MAX;
+  return (float)(log(thresh / (1.0 - thresh)) - 1e-3);
+}
+
+int FusedYoloNumDetections(layer const* l, float thresh)
+{
+  float const logit_thresh = LogitThresh(thresh);
+
+  int count = 0;
+  for (int n = 0; n < l->n; ++n)
+  {
+    float const* obj = l->output + EntryIndex(l, 0, n * l->w * l->h, 4);
+    for (int i = 0; i < l->w * l->h; ++i)
+    {
+      if (obj[i] > logit_thresh && logistic_activate(obj[i]) > thresh)
+        ++count;
+    }
+  }
+  return count;
+}
+
+int GetFusedYoloDetections(
+    layer const* l, int net_w, int net_h, float thresh, Detection* dets)
+{
+  float const* pred = l->output;
+  float const logit_thresh = LogitThresh(thresh);
+  float const alpha = l->scale_x_y;
+  float const beta = -0.5 * (l->scale_x_y - 1);
+  int const stride = l->w * l->h;
+
+  int count = 0;
+  for (int n = 0; n < l->n; ++n)
+  {
+    for (int i = 0; i < stride; ++i)
+    {
+      int loc = n * stride + i;
+      float raw_obj = pred[EntryIndex(l, 0, loc, 4)];
+      if (raw_obj <= logit_thresh)
+        continue;
+
+      float objectness = logistic_activate(raw_obj);
+      if (objectness <= thresh)
+        continue;
+
+      // same transform as ForwardYoloLayer(), applied to this cell only
+      int box_idx = EntryIndex(l, 0, loc, 0);
+      float x[4];
+      x[0] = logistic_activate(pred[box_idx + 0 * stride]) * alpha + beta;
+      x[1] = logistic_activate(pred[box_idx + 1 * stride]) * alpha + beta;
+      x[2] = pred[box_idx + 2 * stride];
+      x[3] = pred[box_idx + 3 * stride];
+
+      dets[count].bbox = GetYoloBox(x, l->biases, l->mask[n], 0, i % l->w,
+          i / l->w, l->w, l->h, net_w, net_h, 1);
+      dets[count].objectness = objectness;
+      dets[count].classes = l->classes;
+
+      float const* cls = pred + EntryIndex(l, 0, loc, 4 + 1);
+      for (int j = 0; j < l->classes; ++j)
+      {
+        float prob = objectness * logistic_activate(cls[j * stride]);
+        dets[count].prob[j] = (prob > thresh) ? prob : 0;
+      }
+      ++count;
+    }
+  }
+
+  return count;
+}
+
+// Sparse counterpart of GetYoloDetections() and GetFusedYoloDetections()
+// keeping the top_k classes of each box; box i takes its classes from
+// pool[i * top_k] and boxes without any class above thresh are dropped
+int GetSparseYoloDetections(layer const* l, int net_w, int net_h, float thresh,
+    bool fused, int top_k, SparseDetection* dets, ClassProb* pool)
+{
+  float const* pred = l->output;
+  float const logit_thresh = fused ? LogitThresh(thresh) : thresh;
+  float const alpha = l->scale_x_y;
+  float const beta = -0.5 * (l->scale_x_y - 1);
+  int const stride = l->w * l->h;
+
+  int count = 0;
+  for (int n = 0; n < l->n; ++n)
+  {
+    for (int i = 0; i < stride; ++i)
+    {
+      int loc = n * stride + i;
+      float objectness = pred[EntryIndex(l, 0, loc, 4)];
+      if (objectness <= logit_thresh)
+        continue;
+
+      if (fused)
+      {
+        objectness = logistic_activate(objectness);
+        if (objectness <= thresh)
+          continue;
+      }
+
+      SparseDetection& det = dets[count];
+      det.probs = pool + count * top_k;
+      det.num_probs = 0;
+
+      // objectness * sigmoid(x) > thresh bounds the logits of classes
+      float const* cls = pred + EntryIndex(l, 0, loc, 4 + 1);
+      float const cls_thresh =
+          fused ? LogitThresh(thresh / objectness) : -FLT_MAX;
+      for (int j = 0; j < l->classes; ++j)
+      {
+        float val = cls[j * stride];
+        if (val <= cls_thresh)
+          continue;
+
+        float prob = objectness * (fused ? logistic_activate(val) : val);
+        if (prob > thresh)
+          InsertClassProb(det.probs, &det.num_probs, top_k, j, prob);
+      }
+      if (det.num_probs == 0)
+        continue;
+
+      int box_idx = EntryIndex(l, 0, loc, 0);
+      if (fused)
+      {
+        float x[4];
+        x[0] = logistic_activate(pred[box_idx + 0 * stride]) * alpha + beta;
+        x[1] = logistic_activate(pred[box_idx + 1 * stride]) * alpha + beta;
+        x[2] = pred[box_idx + 2 * stride];
+        x[3] = pred[box_idx + 3 * stride];
+        det.bbox = GetYoloBox(x, l->biases, l->mask[n], 0, i % l->w, i / l->w,
+            l->w, l->h, net_w, net_h, 1);
+      }
+      else
+      {
+        det.bbox = GetYoloBox(pred, l->biases, l->mask[n], box_idx, i % l->w,
+            i / l->w, l->w, l->h, net_w, net_h, stride);
+      }
+      det.objectness = objectness;
+      ++count;
+    }
+  }
+
+  return count;
+}
+
 #ifdef GPU
 
 void ForwardYoloLayerGpu(layer* l, NetworkState state)
 {
   simple_copy_ongpu(l->batch * l->inputs, state.input, l->output_gpu);
+  if (!state.train && state.net->fused_decode)
+  {
+    cuda_pull_array_async(l->output_gpu, l->output, l->batch * l->outputs);
+    CHECK_CUDA(cudaPeekAtLastError());
+    return;
+  }
+
   for (int b = 0; b < l->batch; ++b)
   {
     for (int n = 0; n < l->n; ++n)
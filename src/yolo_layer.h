@@ -10,6 +10,11 @@ void ResizeYoloLayer(layer* l, int w, int h);
 int YoloNumDetections(layer const* l, float thresh);
 int GetYoloDetections(
     layer const* l, int net_w, int net_h, float thresh, Detection* dets);
+int FusedYoloNumDetections(layer const* l, float thresh);
+int GetFusedYoloDetections(
+    layer const* l, int net_w, int net_h, float thresh, Detection* dets);
+int GetSparseYoloDetections(layer const* l, int net_w, int net_h, float thresh,
+    bool fused, int top_k, SparseDetection* dets, ClassProb* pool);
 
 #ifdef GPU
 void ForwardYoloLayerGpu(layer* l, NetworkState state);